@@ -0,0 +1,1005 @@
+#include "benchmark_functions.h"
+#include "search_server.h"
+#include "log_duration.h"
+#include "corpus_loader.h"
+#include "process_queries.h"
+#include "concurrent_search_server.h"
+#include "segmented_search_server.h"
+#include "sharded_search_server.h"
+#include "remote_sharded_search_server.h"
+#include "remove_duplicates.h"
+#include <cmath>
+#include <iostream>
+#include <execution>
+#include <map>
+#include <tuple>
+#include <set>
+#include <utility>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <future>
+#include <atomic>
+#include <shared_mutex>
+#include <algorithm>
+#include <numeric>
+
+
+#ifndef _WIN32
+#include <csignal>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+using namespace std;
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = uniform_int_distribution<>(1, max_length)(generator);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(uniform_int_distribution<>('a', 'z')(generator));
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+namespace {
+
+// The index layout SearchServer used before the flat posting lists, kept only as a baseline
+class MapIndex {
+public:
+    void AddDocument(int document_id, string_view document) {
+        const vector<string_view> words = SplitIntoWords(document);
+        const double inv_word_count = 1.0 / words.size();
+        for (const string_view word : words) {
+            word_to_document_freqs_[word][document_id] += inv_word_count;
+        }
+        ++document_count_;
+    }
+
+    vector<Document> FindTopDocuments(string_view raw_query) const {
+        vector<string_view> words = SplitIntoWords(raw_query);
+        sort(words.begin(), words.end());
+        words.erase(unique(words.begin(), words.end()), words.end());
+
+        map<int, double> document_to_relevance;
+        for (const string_view word : words) {
+            const auto it = word_to_document_freqs_.find(word);
+            if (it == word_to_document_freqs_.end()) {
+                continue;
+            }
+            const double inverse_document_freq = log(document_count_ * 1.0 / it->second.size());
+            for (const auto [document_id, term_freq] : it->second) {
+                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+            }
+        }
+        vector<Document> result;
+        for (const auto [document_id, relevance] : document_to_relevance) {
+            result.push_back({ document_id, relevance, 0 });
+        }
+        sort(result.begin(), result.end(), [](const Document& lhs, const Document& rhs) {
+            return lhs.relevance > rhs.relevance;
+            });
+        if (result.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            result.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+        return result;
+    }
+
+private:
+    map<string_view, map<int, double>> word_to_document_freqs_;
+    int document_count_ = 0;
+};
+
+}
+
+namespace {
+
+// The tokenizer before the SIMD one, followed by the separate control character scan
+vector<string_view> SplitIntoWordsWithFind(string_view text, bool& has_control_chars) {
+    vector<string_view> result;
+    text.remove_prefix(std::min(text.find_first_not_of(" "), text.size()));
+
+    while (!text.empty()) {
+        int64_t space = text.find(' ');
+        result.push_back(text.substr(0, space));
+        text.remove_prefix(std::min(text.find_first_of(" "), text.size()));
+        text.remove_prefix(std::min(text.find_first_of(" ") + text.find_first_not_of(" "), text.size()));
+    }
+    has_control_chars = false;
+    for (const string_view word : result) {
+        has_control_chars |= any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; });
+    }
+    return result;
+}
+
+}
+
+void BenchmarkPostingLayout() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+
+    MapIndex map_index;
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        map_index.AddDocument(i, documents[i]);
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    {
+        LOG_DURATION("map<string_view, map<int, double>>"s);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto& document : map_index.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+    {
+        LOG_DURATION("flat posting lists"s);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+void BenchmarkParallelScaling() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    {
+        LOG_DURATION("seq"s);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(execution::seq, query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+    const size_t max_threads = max(1u, thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        search_server.SetParallelism(threads);
+        LOG_DURATION("par, "s + to_string(threads) + " threads"s);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(execution::par, query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+void BenchmarkDynamicPruning() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    // Repeating the i-th word about 1000 / i times makes uniform sampling Zipf-like, as in natural text
+    vector<string> skewed_dictionary;
+    for (size_t i = 0; i < dictionary.size(); ++i) {
+        skewed_dictionary.insert(skewed_dictionary.end(), 1000 / (i + 1) + 1, dictionary[i]);
+    }
+
+    for (const vector<string>* words : { &dictionary, &as_const(skewed_dictionary) }) {
+        const string corpus = words == &dictionary ? "uniform"s : "zipf"s;
+        const auto documents = GenerateQueries(generator, *words, 50'000, 70);
+        const auto queries = GenerateQueries(generator, *words, 2'000, 5);
+
+        SearchServer search_server(""s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+
+        for (const bool pruning : { false, true }) {
+            search_server.SetDynamicPruning(pruning);
+            LOG_DURATION(corpus + (pruning ? ", MaxScore"s : ", exhaustive"s));
+            double total_relevance = 0;
+            for (const string_view query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+            cout << total_relevance << endl;
+        }
+    }
+}
+
+void BenchmarkPostingCompression() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+
+    map<string_view, PostingList> index;
+    size_t posting_count = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        vector<string_view> words = SplitIntoWords(documents[i]);
+        sort(words.begin(), words.end());
+        for (auto first = words.begin(); first != words.end();) {
+            const auto last = upper_bound(first, words.end(), *first);
+            const uint32_t term_count = static_cast<uint32_t>(last - first);
+            index[*first].Add(i, term_count, term_count * 1.0 / words.size());
+            ++posting_count;
+            first = last;
+        }
+    }
+
+    size_t compressed_bytes = 0;
+    for (const auto& [word, postings] : index) {
+        compressed_bytes += postings.GetMemoryUsage();
+    }
+    cout << "uncompressed: "s << sizeof(int) + sizeof(double) << " bytes per posting"s << endl;
+    cout << "compressed: "s << compressed_bytes * 1.0 / posting_count << " bytes per posting"s << endl;
+
+    constexpr int ROUNDS = 20;
+    const auto start_time = chrono::steady_clock::now();
+    uint64_t checksum = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const auto& [word, postings] : index) {
+            postings.ForEach(0, numeric_limits<int>::max(), [&checksum](size_t, int document_id, uint32_t term_count) {
+                checksum += document_id + term_count;
+            });
+        }
+    }
+    const chrono::duration<double> duration = chrono::steady_clock::now() - start_time;
+    cout << "decode: "s << posting_count * ROUNDS / duration.count() / 1e6 << " M postings/s (checksum "s << checksum << ")"s << endl;
+}
+
+void BenchmarkSnapshotLoading() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 5);
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.snapshot"s).string();
+
+    SearchServer search_server(""s);
+    {
+        LOG_DURATION("indexing"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+    {
+        LOG_DURATION("saving snapshot"s);
+        search_server.SaveSnapshot(path);
+    }
+    cout << "snapshot: "s << filesystem::file_size(path) / (1 << 20) << " MB"s << endl;
+    {
+        LOG_DURATION("loading snapshot and first queries"s);
+        const SearchServer loaded = SearchServer::LoadSnapshot(path);
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto& document : loaded.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+    filesystem::remove(path);
+}
+
+void BenchmarkBulkIngestion() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    vector<SearchServer::NewDocument> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+
+    const auto report = [&documents](const string& name, const chrono::steady_clock::time_point start_time) {
+        const chrono::duration<double> duration = chrono::steady_clock::now() - start_time;
+        cout << name << ": "s << static_cast<int64_t>(documents.size() / duration.count()) << " docs/s"s << endl;
+    };
+    {
+        SearchServer search_server(""s);
+        const auto start_time = chrono::steady_clock::now();
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        report("AddDocument loop"s, start_time);
+    }
+    {
+        SearchServer search_server(""s);
+        const auto start_time = chrono::steady_clock::now();
+        search_server.AddDocuments(execution::seq, batch);
+        report("AddDocuments, seq"s, start_time);
+    }
+    {
+        SearchServer search_server(""s);
+        const auto start_time = chrono::steady_clock::now();
+        search_server.AddDocuments(execution::par, batch);
+        report("AddDocuments, par"s, start_time);
+    }
+}
+
+void BenchmarkCorpusLoading() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.corpus"s).string();
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            out << i << "\tACTUAL\t1 2 3\t"s << documents[i] << '\n';
+        }
+    }
+
+    {
+        LOG_DURATION("getline and AddDocument"s);
+        SearchServer search_server(""s);
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            istringstream fields(line);
+            int id = 0;
+            string status;
+            fields >> id >> status;
+            vector<int> ratings(3);
+            fields >> ratings[0] >> ratings[1] >> ratings[2];
+            fields.ignore(1);
+            string text;
+            getline(fields, text);
+            search_server.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+        }
+    }
+    {
+        LOG_DURATION("LoadCorpus"s);
+        SearchServer search_server(""s);
+        LoadCorpus(search_server, path);
+    }
+    filesystem::remove(path);
+}
+
+void BenchmarkTokenizer() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    size_t byte_count = 0;
+    for (const string& document : documents) {
+        byte_count += document.size();
+    }
+
+    using Tokenizer = vector<string_view>(*)(string_view, bool&);
+    for (const auto& [name, tokenizer] : { pair<string, Tokenizer>{ "find-based SplitIntoWords"s, SplitIntoWordsWithFind },
+        pair<string, Tokenizer>{ "SIMD SplitIntoWords"s, SplitIntoWords } }) {
+        constexpr int ROUNDS = 5;
+        const auto start_time = chrono::steady_clock::now();
+        size_t word_count = 0;
+        for (int round = 0; round < ROUNDS; ++round) {
+            for (const string& document : documents) {
+                bool has_control_chars = false;
+                word_count += tokenizer(document, has_control_chars).size() + has_control_chars;
+            }
+        }
+        const chrono::duration<double> duration = chrono::steady_clock::now() - start_time;
+        cout << name << ": "s << byte_count * ROUNDS / duration.count() / (1 << 20) << " MB/s ("s << word_count << " words)"s << endl;
+    }
+}
+
+void BenchmarkStopWords() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 20'000, 70);
+    const set<string, less<>> stop_words(dictionary.begin(), dictionary.begin() + 200);
+    const StopWordFilter filter(stop_words);
+    vector<string_view> tokens;
+    for (const string& document : documents) {
+        const auto words = SplitIntoWords(document);
+        tokens.insert(tokens.end(), words.begin(), words.end());
+    }
+
+    size_t set_hits = 0;
+    {
+        LOG_DURATION("set<string, less<>> lookups"s);
+        for (const string_view token : tokens) {
+            set_hits += stop_words.count(token);
+        }
+    }
+    size_t filter_hits = 0;
+    {
+        LOG_DURATION("StopWordFilter lookups"s);
+        for (const string_view token : tokens) {
+            filter_hits += filter.Contains(token);
+        }
+    }
+    cout << tokens.size() << " tokens, "s << set_hits << " and "s << filter_hits << " stop words"s << endl;
+}
+
+void BenchmarkQueryCache() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto distinct_queries = GenerateQueries(generator, dictionary, 10'000, 5);
+    // Zipf with s = 1: the i-th query is picked with probability proportional to 1 / (i + 1)
+    vector<double> weights(distinct_queries.size());
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    vector<string_view> queries;
+    for (int i = 0; i < 20'000; ++i) {
+        queries.push_back(distinct_queries[zipf(generator)]);
+    }
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    for (const auto& [name, capacity, cache_results] : { tuple{ "no cache"s, 0, false },
+        tuple{ "plan cache"s, 1000, false }, tuple{ "plan and result cache"s, 1000, true } }) {
+        search_server.SetQueryCache(capacity, cache_results);
+        {
+            LOG_DURATION(name);
+            double total_relevance = 0;
+            for (const string_view query : queries) {
+                for (const auto& document : search_server.FindTopDocuments(query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+            cout << total_relevance << endl;
+        }
+        const QueryCacheStats stats = cache_results ? search_server.GetQueryResultCacheStats() : search_server.GetQueryPlanCacheStats();
+        if (capacity != 0) {
+            cout << "hit rate "s << stats.hits * 100.0 / (stats.hits + stats.misses) << "%, "s << stats.evictions << " evictions"s << endl;
+        }
+    }
+}
+
+void BenchmarkQueryExecutor() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    // Long queries grouped at the front, so an even split gives one thread most of the work
+    auto queries = GenerateQueries(generator, dictionary, 100, 70);
+    const auto short_queries = GenerateQueries(generator, dictionary, 2'000, 3);
+    queries.insert(queries.end(), short_queries.begin(), short_queries.end());
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    const auto total_relevance = [](const vector<vector<Document>>& results) {
+        double total = 0;
+        for (const auto& documents : results) {
+            for (const auto& document : documents) {
+                total += document.relevance;
+            }
+        }
+        return total;
+    };
+    {
+        LOG_DURATION("transform(par)"s);
+        vector<vector<Document>> results(queries.size());
+        transform(execution::par, queries.begin(), queries.end(), results.begin(),
+            [&search_server](const string& query) { return search_server.FindTopDocuments(query); });
+        cout << total_relevance(results) << endl;
+    }
+    const size_t max_threads = max(1u, thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        QueryExecutor executor(threads);
+        LOG_DURATION("QueryExecutor, "s + to_string(threads) + " threads"s);
+        cout << total_relevance(ProcessQueries(executor, search_server, queries)) << endl;
+    }
+}
+
+void BenchmarkJoinedResults() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 20'000, 3);
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    {
+        LOG_DURATION("ProcessQueries and flattening copy"s);
+        double total_relevance = 0;
+        vector<Document> joined;
+        for (const auto& result : ProcessQueries(search_server, queries)) {
+            joined.insert(joined.end(), result.begin(), result.end());
+        }
+        for (const Document& document : joined) {
+            total_relevance += document.relevance;
+        }
+        cout << total_relevance << endl;
+    }
+    {
+        LOG_DURATION("ProcessQueriesJoined"s);
+        double total_relevance = 0;
+        for (const Document& document : ProcessQueriesJoined(search_server, queries)) {
+            total_relevance += document.relevance;
+        }
+        cout << total_relevance << endl;
+    }
+    {
+        LOG_DURATION("ProcessQueriesJoinedView"s);
+        double total_relevance = 0;
+        for (const Document& document : ProcessQueriesJoinedView(search_server, queries)) {
+            total_relevance += document.relevance;
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+void BenchmarkQueryDeadlines() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 500, 70);
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+
+    // The whole batch is submitted at once, far more than the executor keeps up with
+    QueryExecutor executor;
+    for (const auto timeout : { chrono::milliseconds(0), chrono::milliseconds(500), chrono::milliseconds(100) }) {
+        const bool has_deadline = timeout.count() != 0;
+        const auto start = chrono::steady_clock::now();
+        vector<future<SearchServer::QueryResult>> results;
+        for (const string& query : queries) {
+            results.push_back(search_server.FindTopDocumentsAsync(query,
+                has_deadline ? CancellationToken::WithTimeout(timeout) : CancellationToken(), MAX_RESULT_DOCUMENT_COUNT, executor));
+        }
+        int complete = 0;
+        for (auto& result : results) {
+            complete += result.get().complete;
+        }
+        const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        cout << (has_deadline ? to_string(timeout.count()) + " ms deadline"s : "no deadline"s) << ": "s
+            << complete << " of "s << queries.size() << " complete, all answered in "s << elapsed.count() << " ms"s << endl;
+    }
+}
+
+namespace {
+
+// Latencies of queries run in a loop while ingest runs on the calling thread
+template <typename RunQuery, typename Ingest>
+vector<double> MeasureQueryLatencies(RunQuery run_query, Ingest ingest) {
+    atomic<bool> done = false;
+    vector<double> latencies;
+    thread reader([&] {
+        while (!done) {
+            const auto start = chrono::steady_clock::now();
+            run_query();
+            latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+    });
+    ingest();
+    done = true;
+    reader.join();
+    sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+void PrintLatencies(const string& name, const vector<double>& latencies) {
+    if (latencies.empty()) {
+        return;
+    }
+    cout << name << ": "s << latencies.size() << " queries, p50 "s << latencies[latencies.size() / 2]
+        << " ms, p99 "s << latencies[latencies.size() * 99 / 100] << " ms, max "s << latencies.back() << " ms"s << endl;
+}
+
+}
+
+void BenchmarkConcurrentUpdates() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 60'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 10);
+    const size_t initial_count = 40'000;
+    const size_t batch_size = 2'000;
+
+    const auto build_initial = [&]() {
+        SearchServer search_server(""s);
+        for (size_t i = 0; i < initial_count; ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        return search_server;
+    };
+
+    {
+        // Stop the world: writers hold the lock for a whole batch
+        SearchServer search_server = build_initial();
+        shared_mutex mutex;
+        size_t next_query = 0;
+        PrintLatencies("shared_mutex"s, MeasureQueryLatencies(
+            [&]() {
+                shared_lock lock(mutex);
+                search_server.FindTopDocuments(queries[next_query++ % queries.size()]);
+            },
+            [&]() {
+                for (size_t first = initial_count; first < documents.size(); first += batch_size) {
+                    unique_lock lock(mutex);
+                    for (size_t i = first; i < first + batch_size; ++i) {
+                        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+                    }
+                }
+            }));
+    }
+    {
+        ConcurrentSearchServer search_server(build_initial());
+        size_t next_query = 0;
+        PrintLatencies("ConcurrentSearchServer"s, MeasureQueryLatencies(
+            [&]() {
+                search_server.GetSnapshot()->FindTopDocuments(queries[next_query++ % queries.size()]);
+            },
+            [&]() {
+                for (size_t first = initial_count; first < documents.size(); first += batch_size) {
+                    search_server.Update([&](SearchServer& version) {
+                        for (size_t i = first; i < first + batch_size; ++i) {
+                            version.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+                        }
+                    });
+                }
+            }));
+    }
+}
+
+void BenchmarkSegmentedIngestion() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 60'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 10);
+    const size_t initial_count = 40'000;
+    const size_t batch_size = 2'000;
+
+    {
+        // One index: every batch republishes a copy of all of it
+        SearchServer initial(""s);
+        for (size_t i = 0; i < initial_count; ++i) {
+            initial.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        ConcurrentSearchServer search_server(move(initial));
+        size_t next_query = 0;
+        LOG_DURATION("ConcurrentSearchServer ingest"s);
+        PrintLatencies("ConcurrentSearchServer"s, MeasureQueryLatencies(
+            [&]() {
+                search_server.GetSnapshot()->FindTopDocuments(queries[next_query++ % queries.size()]);
+            },
+            [&]() {
+                for (size_t first = initial_count; first < documents.size(); first += batch_size) {
+                    search_server.Update([&](SearchServer& version) {
+                        for (size_t i = first; i < first + batch_size; ++i) {
+                            version.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+                            if (i % 10 == 0) {
+                                version.RemoveDocument(i - initial_count);
+                            }
+                        }
+                    });
+                }
+            }));
+    }
+    {
+        SegmentedSearchServer search_server(""s, MergePolicy{ batch_size, 4 });
+        for (size_t i = 0; i < initial_count; ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        search_server.WaitForMerges();
+        size_t next_query = 0;
+        LOG_DURATION("SegmentedSearchServer ingest"s);
+        PrintLatencies("SegmentedSearchServer"s, MeasureQueryLatencies(
+            [&]() {
+                search_server.FindTopDocuments(queries[next_query++ % queries.size()]);
+            },
+            [&]() {
+                // Every tenth write also removes an old document of a sealed segment
+                for (size_t i = initial_count; i < documents.size(); ++i) {
+                    search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+                    if (i % 10 == 0) {
+                        search_server.RemoveDocument(i - initial_count);
+                    }
+                }
+            }));
+        cout << search_server.GetSegmentCount() << " segments"s << endl;
+    }
+}
+
+void BenchmarkSharding() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+
+    SearchServer single(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        single.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    single.PrepareScoringTables();
+    {
+        LOG_DURATION("single server"s);
+        double total_relevance = 0;
+        for (const string& query : queries) {
+            for (const auto& document : single.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+    const size_t max_shards = max<size_t>(4, thread::hardware_concurrency());
+    for (size_t shard_count = 1; shard_count <= max_shards; shard_count *= 2) {
+        ShardedSearchServer sharded(""s, shard_count);
+        vector<SearchServer::NewDocument> batch;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+        }
+        sharded.AddDocuments(batch);
+        for (size_t shard = 0; shard < shard_count; ++shard) {
+            sharded.GetShard(shard).PrepareScoringTables();
+        }
+        LOG_DURATION(to_string(shard_count) + " shards"s);
+        double total_relevance = 0;
+        for (const string& query : queries) {
+            for (const auto& document : sharded.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+}
+
+#ifndef _WIN32
+namespace {
+
+// Starts the shard_server binary; exec right away keeps the child clear of this process's threads
+pid_t StartShardServer(const string& shard_server_path, const string& snapshot, const string& socket) {
+    vector<string> arguments = { shard_server_path, snapshot, socket };
+    vector<char*> argv;
+    for (string& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawn(&pid, shard_server_path.c_str(), nullptr, nullptr, argv.data(), environ) != 0) {
+        throw runtime_error("can't start "s + shard_server_path);
+    }
+    return pid;
+}
+
+// Waits until the shard server listens on socket; false if it exited or didn't start within the timeout
+bool WaitForShardServer(pid_t pid, const string& socket, chrono::seconds timeout) {
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    while (!filesystem::exists(socket)) {
+        // WNOWAIT leaves an exited server to be reaped with the others
+        siginfo_t info{};
+        if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid != 0
+            || chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return true;
+}
+
+}
+#endif
+
+void BenchmarkRemoteShards(const string& shard_server_path) {
+#ifdef _WIN32
+    cout << "remote shards need unix domain sockets"s << endl;
+#else
+    if (shard_server_path.empty()) {
+        cout << "remote shards: pass the path of the shard_server binary after --benchmarks"s << endl;
+        return;
+    }
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 500, 5);
+    const size_t shard_count = 2;
+
+    ShardedSearchServer local(""s, shard_count);
+    vector<SearchServer::NewDocument> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back({ static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    local.AddDocuments(batch);
+
+    // Every shard process is the shard_server binary serving one saved shard
+    const auto directory = filesystem::temp_directory_path();
+    vector<string> sockets;
+    vector<pid_t> processes;
+    const auto stop_shards = [&]() {
+        for (size_t shard = 0; shard < processes.size(); ++shard) {
+            kill(processes[shard], SIGTERM);
+            waitpid(processes[shard], nullptr, 0);
+        }
+        for (size_t shard = 0; shard < shard_count; ++shard) {
+            filesystem::remove(directory / ("search_server_shard_"s + to_string(shard) + ".sock"s));
+            filesystem::remove(directory / ("search_server_shard_"s + to_string(shard) + ".snapshot"s));
+        }
+    };
+    try {
+        for (size_t shard = 0; shard < shard_count; ++shard) {
+            const string snapshot = (directory / ("search_server_shard_"s + to_string(shard) + ".snapshot"s)).string();
+            sockets.push_back((directory / ("search_server_shard_"s + to_string(shard) + ".sock"s)).string());
+            filesystem::remove(sockets.back());
+            local.GetShard(shard).SaveSnapshot(snapshot);
+            processes.push_back(StartShardServer(shard_server_path, snapshot, sockets.back()));
+        }
+    }
+    catch (const exception& e) {
+        cout << "remote shards: "s << e.what() << endl;
+        stop_shards();
+        return;
+    }
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        if (!WaitForShardServer(processes[shard], sockets[shard], chrono::seconds(30))) {
+            cout << "remote shards: shard server "s << shard << " didn't start"s << endl;
+            stop_shards();
+            return;
+        }
+    }
+
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        local.GetShard(shard).PrepareScoringTables();
+    }
+    const auto run = [&queries](const string& name, auto find_top_documents) {
+        vector<double> latencies;
+        double total_relevance = 0;
+        const auto start = chrono::steady_clock::now();
+        for (const string& query : queries) {
+            const auto query_start = chrono::steady_clock::now();
+            for (const auto& document : find_top_documents(query)) {
+                total_relevance += document.relevance;
+            }
+            latencies.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - query_start).count());
+        }
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << total_relevance << endl;
+        sort(latencies.begin(), latencies.end());
+        cout << name << ": "s << static_cast<int>(queries.size() / seconds) << " queries/s"s << endl;
+        PrintLatencies(name, latencies);
+    };
+    run("in-process shards"s, [&local](const string& query) { return local.FindTopDocuments(query); });
+    {
+        RemoteShardedSearchServer remote(sockets);
+        run("shard processes"s, [&remote](const string& query) { return remote.FindTopDocuments(query); });
+    }
+    stop_shards();
+#endif
+}
+
+void BenchmarkDocumentRemoval() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 50'000, 70);
+    const auto queries = GenerateQueries(generator, dictionary, 1'000, 7);
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    vector<int> removed_ids(documents.size());
+    iota(removed_ids.begin(), removed_ids.end(), 0);
+    shuffle(removed_ids.begin(), removed_ids.end(), generator);
+    removed_ids.resize(documents.size() * 2 / 5);
+
+    const auto run_queries = [&search_server, &queries](const string& name) {
+        search_server.PrepareScoringTables();
+        LOG_DURATION(name);
+        double total_relevance = 0;
+        for (const string& query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    };
+    {
+        const auto start_time = chrono::steady_clock::now();
+        for (const int id : removed_ids) {
+            search_server.RemoveDocument(id);
+        }
+        const chrono::duration<double, micro> duration = chrono::steady_clock::now() - start_time;
+        cout << "RemoveDocument: "s << duration.count() / removed_ids.size() << " us per document"s << endl;
+    }
+    run_queries("queries with removed documents"s);
+    {
+        LOG_DURATION("Compact"s);
+        search_server.Compact();
+    }
+    run_queries("queries after compaction"s);
+}
+
+void BenchmarkRemoveDuplicates() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+
+    SearchServer search_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        // Every tenth document comes back with its words in reverse order
+        if (i % 10 == 0) {
+            string reversed;
+            for (const string_view word : SplitIntoWords(documents[i])) {
+                reversed = string(word) + ' ' + reversed;
+            }
+            search_server.AddDocument(documents.size() + i, reversed, DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+    {
+        LOG_DURATION("RemoveDuplicates"s);
+        RemoveDuplicates(search_server);
+    }
+    cout << search_server.GetDocumentCount() << " documents left"s << endl;
+}
+
+void BenchmarkNearDuplicates() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, 100'000, 70);
+
+    SearchServer search_server(""s);
+    int copy_count = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        // Every tenth document comes back with one more word
+        if (i % 10 == 0) {
+            search_server.AddDocument(documents.size() + i, documents[i] + ' ' + dictionary[generator() % dictionary.size()],
+                DocumentStatus::ACTUAL, { 1, 2, 3 });
+            ++copy_count;
+        }
+    }
+    LOG_DURATION("FindNearDuplicates"s);
+    const auto duplicates = FindNearDuplicates(search_server);
+    cout << duplicates.size() << " of "s << copy_count << " copies found"s << endl;
+}
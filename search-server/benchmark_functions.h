@@ -0,0 +1,74 @@
+#pragma once
+#include <random>
+#include <string>
+#include <vector>
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
+
+// Compares query time of the flat posting lists against the former std::map<std::string_view, std::map<int, double>> layout
+void BenchmarkPostingLayout();
+
+// Runs the same parallel queries with 1, 2, 4, ... worker threads up to the hardware concurrency
+void BenchmarkParallelScaling();
+
+// Exhaustive scoring against MaxScore pruning on five-word queries over uniform and Zipf-like vocabularies
+void BenchmarkDynamicPruning();
+
+// Bytes per posting of the compressed posting lists and their decoding throughput
+void BenchmarkPostingCompression();
+
+// Cold start from a snapshot against indexing the corpus with AddDocument
+void BenchmarkSnapshotLoading();
+
+// Ingestion throughput of the AddDocument loop against the bulk AddDocuments
+void BenchmarkBulkIngestion();
+
+// Reading a corpus file line by line into AddDocument against the mapped, pipelined LoadCorpus
+void BenchmarkCorpusLoading();
+
+// Throughput of the SIMD tokenizer against the former find-based one plus a separate control character scan
+void BenchmarkTokenizer();
+
+// IsStopWord lookups in the former std::set against StopWordFilter
+void BenchmarkStopWords();
+
+// Zipf-distributed repeated queries without a cache, with the plan cache and with plan and result caches
+void BenchmarkQueryCache();
+
+// Skewed batch of long and short queries on std::transform(par) and on QueryExecutor with 1, 2, 4... threads
+void BenchmarkQueryExecutor();
+
+// Short queries joined by copying per-query vectors, by ProcessQueriesJoined and through the
+// single-buffer JoinedDocuments view
+void BenchmarkJoinedResults();
+
+// An overloading burst of async queries without a deadline and with 500 and 100 ms deadlines
+void BenchmarkQueryDeadlines();
+
+// Query latency while batches are ingested, behind a shared_mutex and with published versions
+void BenchmarkConcurrentUpdates();
+
+// Query latency and ingest time while documents stream into a copied index and into segments
+void BenchmarkSegmentedIngestion();
+
+// Long queries on one server and on 1, 2, 4... shards with scatter-gather
+void BenchmarkSharding();
+
+// Throughput and latency of two shards in this process and in shard_server processes over unix sockets.
+// Skipped without the path of the shard_server binary
+void BenchmarkRemoteShards(const std::string& shard_server_path);
+
+// Cost of removing documents and of queries before and after the compaction
+void BenchmarkDocumentRemoval();
+
+// RemoveDuplicates on a corpus where every tenth document is repeated with its words reordered
+void BenchmarkRemoveDuplicates();
+
+// FindNearDuplicates on a corpus where every tenth document is repeated with an extra word
+void BenchmarkNearDuplicates();
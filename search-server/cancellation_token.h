@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// Cancellation flag with an optional deadline. Copies share the flag, so a token handed to a
+// query can be cancelled from another thread through any copy of it
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CancellationToken()
+        : cancelled_(std::make_shared<std::atomic<bool>>(false)) {
+    }
+
+    // Also counts as cancelled from the deadline on
+    explicit CancellationToken(Clock::time_point deadline)
+        : cancelled_(std::make_shared<std::atomic<bool>>(false))
+        , deadline_(deadline) {
+    }
+
+    static CancellationToken WithTimeout(Clock::duration timeout) {
+        return CancellationToken(Clock::now() + timeout);
+    }
+
+    void Cancel() const {
+        cancelled_->store(true, std::memory_order_relaxed);
+    }
+
+    bool IsCancelled() const {
+        return cancelled_->load(std::memory_order_relaxed) || (deadline_ != Clock::time_point::max() && Clock::now() >= deadline_);
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+    Clock::time_point deadline_ = Clock::time_point::max();
+};
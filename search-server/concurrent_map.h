@@ -40,7 +40,7 @@ public:
 
     bool Erase(const Key& key) {
         const size_t residual = static_cast<size_t> (key) % submaps_.size();
-        std::lock_guard<std::mutex>(submaps_[residual].first);
+        std::lock_guard<std::mutex> guard(submaps_[residual].first);
         return submaps_[residual].second.erase(key);
     }
 
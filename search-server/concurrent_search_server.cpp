@@ -0,0 +1,38 @@
+#include "concurrent_search_server.h"
+#include <atomic>
+#include <utility>
+
+ConcurrentSearchServer::ConcurrentSearchServer(SearchServer search_server) {
+	auto version = std::make_shared<SearchServer>(std::move(search_server));
+	version->PrepareScoringTables();
+	current_ = std::move(version);
+}
+
+std::shared_ptr<const SearchServer> ConcurrentSearchServer::GetSnapshot() const {
+	return std::atomic_load(&current_);
+}
+
+std::vector<SearchServer::AddResult> ConcurrentSearchServer::AddDocuments(const std::vector<SearchServer::NewDocument>& documents) {
+	std::vector<SearchServer::AddResult> results;
+	Update([&](SearchServer& search_server) { results = search_server.AddDocuments(documents); });
+	return results;
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+	Update([&document_ids](SearchServer& search_server) {
+		for (const int document_id : document_ids) {
+			search_server.RemoveDocument(document_id);
+		}
+	});
+}
+
+uint64_t ConcurrentSearchServer::GetVersion() const {
+	return version_;
+}
+
+void ConcurrentSearchServer::Publish(std::shared_ptr<const SearchServer> version) {
+	// Readers never rebuild the scoring tables of a published version, so they never contend on them
+	version->PrepareScoringTables();
+	std::atomic_store(&current_, std::move(version));
+	++version_;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+
+// SearchServer that can be changed while queries run. Readers pin an immutable version with
+// GetSnapshot and query it without locks; a writer copies the current version, changes the copy
+// and publishes it atomically. A version is freed when the last snapshot of it is released.
+// Every publication copies the whole index, so there are no single-document writes: group
+// changes with Update or the batch methods, each of which publishes once
+class ConcurrentSearchServer {
+public:
+    explicit ConcurrentSearchServer(SearchServer search_server);
+
+    // The current version; stays valid and unchanged for as long as it is held
+    std::shared_ptr<const SearchServer> GetSnapshot() const;
+
+    // Applies change to a copy of the current version and publishes the copy. Writers are
+    // serialized. If change throws, nothing is published and the exception propagates
+    template <typename Change>
+    void Update(Change change);
+
+    std::vector<SearchServer::AddResult> AddDocuments(const std::vector<SearchServer::NewDocument>& documents);
+
+    // Unknown ids are skipped
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Number of published versions, the initial one included
+    uint64_t GetVersion() const;
+
+private:
+    std::shared_ptr<const SearchServer> current_;
+    std::mutex write_mutex_;
+    std::atomic<uint64_t> version_ = 1;
+
+    void Publish(std::shared_ptr<const SearchServer> version);
+};
+
+template <typename Change>
+void ConcurrentSearchServer::Update(Change change) {
+    std::lock_guard guard(write_mutex_);
+    auto version = std::make_shared<SearchServer>(*GetSnapshot());
+    change(*version);
+    Publish(std::move(version));
+}
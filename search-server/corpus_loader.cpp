@@ -0,0 +1,87 @@
+#include "corpus_loader.h"
+#include "mapped_file.h"
+#include <charconv>
+#include <future>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(string_view text, DocumentStatus& status) {
+    static const pair<string_view, DocumentStatus> names[] = {
+        { "ACTUAL"sv, DocumentStatus::ACTUAL },
+        { "IRRELEVANT"sv, DocumentStatus::IRRELEVANT },
+        { "BANNED"sv, DocumentStatus::BANNED },
+        { "REMOVED"sv, DocumentStatus::REMOVED },
+    };
+    for (const auto& [name, value] : names) {
+        if (text == name) {
+            status = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Cuts the text up to the next separator off the front of line
+string_view TakeField(string_view& line, char separator) {
+    const size_t end = min(line.find(separator), line.size());
+    const string_view field = line.substr(0, end);
+    line.remove_prefix(min(end + 1, line.size()));
+    return field;
+}
+
+SearchServer::NewDocument ParseCorpusLine(string_view line, size_t line_number) {
+    SearchServer::NewDocument document{ 0, {}, DocumentStatus::ACTUAL, {} };
+    const string_view id = TakeField(line, '\t');
+    const string_view status = TakeField(line, '\t');
+    string_view ratings = TakeField(line, '\t');
+    if (!ParseInt(id, document.id) || !ParseStatus(status, document.status)) {
+        throw invalid_argument("malformed corpus line "s + to_string(line_number));
+    }
+    for (const string_view rating : SplitIntoWords(ratings)) {
+        document.ratings.push_back(0);
+        if (!ParseInt(rating, document.ratings.back())) {
+            throw invalid_argument("malformed rating on corpus line "s + to_string(line_number));
+        }
+    }
+    document.text = line;
+    return document;
+}
+
+}
+
+vector<SearchServer::AddResult> LoadCorpus(SearchServer& search_server, const string& path, size_t batch_size) {
+    const auto file = MappedFile::Open(path);
+    string_view unread(file->data(), file->size());
+    size_t line_number = 0;
+    const auto parse_batch = [&unread, &line_number, batch_size]() {
+        vector<SearchServer::NewDocument> batch;
+        while (!unread.empty() && batch.size() < batch_size) {
+            string_view line = TakeField(unread, '\n');
+            ++line_number;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (!line.empty()) {
+                batch.push_back(ParseCorpusLine(line, line_number));
+            }
+        }
+        return batch;
+    };
+
+    vector<SearchServer::AddResult> results;
+    future<vector<SearchServer::NewDocument>> next_batch = async(launch::async, parse_batch);
+    for (vector<SearchServer::NewDocument> batch = next_batch.get(); !batch.empty(); batch = next_batch.get()) {
+        next_batch = async(launch::async, parse_batch);
+        const auto batch_results = search_server.AddDocuments(execution::par, batch);
+        results.insert(results.end(), batch_results.begin(), batch_results.end());
+    }
+    return results;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "search_server.h"
+
+// Corpus files hold one document per line, fields separated by tabs:
+//   <id>\t<status>\t<ratings separated by spaces>\t<text>
+// status is ACTUAL, IRRELEVANT, BANNED or REMOVED; empty lines are skipped.
+//
+// The file is mapped and the texts are handed to AddDocuments as views into the mapping,
+// so no line is copied. Batches are parsed on a second thread while the previous batch
+// is indexed, which also takes the page faults of the mapping off the indexing path.
+// Returns the AddDocuments outcome of every document in file order. Throws std::runtime_error
+// if the file can't be mapped and std::invalid_argument for a malformed line; the batches
+// before that line stay indexed
+std::vector<SearchServer::AddResult> LoadCorpus(SearchServer& search_server, const std::string& path,
+    size_t batch_size = 10'000);
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Contiguous array that either owns its elements or views read-only memory,
+// such as a mapped snapshot. The first mutation copies a view into owned storage.
+// A view doesn't keep its memory alive; whoever hands it out must
+template <typename T>
+class MappedArray {
+public:
+    MappedArray() = default;
+
+    static MappedArray View(const T* data, size_t size) {
+        MappedArray array;
+        array.view_ = size != 0 ? data : nullptr;
+        array.view_size_ = size;
+        return array;
+    }
+
+    const T* data() const {
+        return view_ != nullptr ? view_ : owned_.data();
+    }
+
+    size_t size() const {
+        return view_ != nullptr ? view_size_ : owned_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const T* begin() const {
+        return data();
+    }
+
+    const T* end() const {
+        return data() + size();
+    }
+
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    // Owned storage for changes; copies the viewed elements on the first call
+    std::vector<T>& Mutable() {
+        if (view_ != nullptr) {
+            owned_.assign(view_, view_ + view_size_);
+            view_ = nullptr;
+        }
+        return owned_;
+    }
+
+    // Heap bytes, or the viewed bytes for a view
+    size_t GetMemoryUsage() const {
+        return view_ != nullptr ? view_size_ * sizeof(T) : owned_.capacity() * sizeof(T);
+    }
+
+private:
+    std::vector<T> owned_;
+    const T* view_ = nullptr;
+    size_t view_size_ = 0;
+};
@@ -0,0 +1,223 @@
+#include "posting_list.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+void AppendVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+	while (value >= 0x80) {
+		bytes.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& data) {
+	uint32_t value = *data & 0x7f;
+	for (int shift = 7; *data++ & 0x80; shift += 7) {
+		value |= static_cast<uint32_t>(*data & 0x7f) << shift;
+	}
+	return value;
+}
+
+// The same for untrusted bytes: false instead of reading at or past end
+bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+	value = 0;
+	for (int shift = 0; data != end && shift < 35; shift += 7) {
+		const uint8_t byte = *data++;
+		value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+}
+
+void PostingList::Add(int document_id, uint32_t term_count, double term_freq) {
+	// Documents usually arrive in increasing id order, so the common case is an append to the last block
+	if (blocks_.empty() || blocks_.back().last_id < document_id) {
+		if (blocks_.empty() || blocks_.back().size == BLOCK_SIZE) {
+			blocks_.Mutable().push_back({ document_id, document_id, static_cast<uint32_t>(bytes_.size()),
+				static_cast<uint32_t>(size_), 0, 0, term_freq });
+		}
+		BlockHeader& block = blocks_.Mutable().back();
+		AppendVarint(bytes_.Mutable(), static_cast<uint32_t>(document_id - block.last_id));
+		AppendVarint(bytes_.Mutable(), term_count);
+		block.last_id = document_id;
+		block.max_term_freq = std::max(block.max_term_freq, term_freq);
+		++block.size;
+		++size_;
+		return;
+	}
+
+	const size_t block = FindBlock(document_id);
+	std::vector<int> document_ids(blocks_[block].size);
+	std::vector<uint32_t> term_counts(blocks_[block].size);
+	DecodeBlock(block, document_ids.data(), term_counts.data());
+	const auto it = std::lower_bound(document_ids.begin(), document_ids.end(), document_id);
+	const auto pos = std::distance(document_ids.begin(), it);
+	double max_term_freq = blocks_[block].max_term_freq;
+	if (it != document_ids.end() && *it == document_id) {
+		// The frequency grows in proportion to the count
+		max_term_freq = std::max(max_term_freq, term_freq * (term_counts[pos] + term_count) / term_count);
+		term_counts[pos] += term_count;
+	}
+	else {
+		max_term_freq = std::max(max_term_freq, term_freq);
+		document_ids.insert(it, document_id);
+		term_counts.insert(term_counts.begin() + pos, term_count);
+		++size_;
+	}
+	ReplaceBlock(block, document_ids, term_counts, max_term_freq);
+}
+
+bool PostingList::Contains(int document_id) const {
+	const size_t block = FindBlock(document_id);
+	if (block == blocks_.size() || blocks_[block].first_id > document_id) {
+		return false;
+	}
+	std::array<int, BLOCK_SIZE> document_ids;
+	std::array<uint32_t, BLOCK_SIZE> term_counts;
+	const size_t count = DecodeBlock(block, document_ids.data(), term_counts.data());
+	return std::binary_search(document_ids.begin(), document_ids.begin() + count, document_id);
+}
+
+double PostingList::GetMaxTermFreq(int first_id, int last_id) const {
+	double max_term_freq = 0.0;
+	for (size_t block = FindBlock(first_id); block < blocks_.size() && blocks_[block].first_id < last_id; ++block) {
+		max_term_freq = std::max(max_term_freq, blocks_[block].max_term_freq);
+	}
+	return max_term_freq;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+	return bytes_.GetMemoryUsage() + blocks_.GetMemoryUsage();
+}
+
+void PostingList::SaveSnapshot(SnapshotWriter& writer) const {
+	writer.Write<uint64_t>(size_);
+	writer.WriteArray(bytes_.data(), bytes_.size());
+	writer.WriteArray(blocks_.data(), blocks_.size());
+}
+
+void PostingList::LoadSnapshot(SnapshotReader& reader) {
+	size_ = reader.Read<uint64_t>();
+	bytes_ = reader.ReadArray<uint8_t>();
+	blocks_ = reader.ReadArray<BlockHeader>();
+
+	uint64_t position = 0;
+	for (size_t i = 0; i < blocks_.size(); ++i) {
+		const BlockHeader& block = blocks_[i];
+		const size_t end = i + 1 < blocks_.size() ? blocks_[i + 1].offset : bytes_.size();
+		if (block.size == 0 || block.size > BLOCK_SIZE || block.position != position || block.offset > end
+			|| end > bytes_.size() || (i > 0 && block.first_id <= blocks_[i - 1].last_id)) {
+			throw std::runtime_error("damaged snapshot: bad posting block header");
+		}
+		// Decoding must stay within the block and end at its last id
+		const uint8_t* data = bytes_.data() + block.offset;
+		int64_t document_id = block.first_id;
+		for (uint32_t j = 0; j < block.size; ++j) {
+			uint32_t delta = 0;
+			uint32_t term_count = 0;
+			if (!ReadVarint(data, bytes_.data() + end, delta) || !ReadVarint(data, bytes_.data() + end, term_count)
+				|| (j == 0) != (delta == 0) || document_id + delta > block.last_id) {
+				throw std::runtime_error("damaged snapshot: bad posting block");
+			}
+			document_id += delta;
+		}
+		if (document_id != block.last_id || data != bytes_.data() + end) {
+			throw std::runtime_error("damaged snapshot: bad posting block");
+		}
+		position += block.size;
+	}
+	if (position != size_ || (blocks_.empty() ? !bytes_.empty() : blocks_[0].offset != 0)) {
+		throw std::runtime_error("damaged snapshot: bad posting list");
+	}
+}
+
+bool PostingList::HasIdsWithin(int first_id, int last_id) const {
+	return blocks_.empty() || (blocks_[0].first_id >= first_id && blocks_.back().last_id < last_id);
+}
+
+size_t PostingList::FindBlock(int document_id) const {
+	return std::partition_point(blocks_.begin(), blocks_.end(),
+		[document_id](const BlockHeader& block) { return block.last_id < document_id; }) - blocks_.begin();
+}
+
+size_t PostingList::DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const {
+	const BlockHeader& header = blocks_[block];
+	const uint8_t* data = bytes_.data() + header.offset;
+	int document_id = header.first_id;
+	for (uint32_t i = 0; i < header.size; ++i) {
+		document_id += static_cast<int>(ReadVarint(data));
+		document_ids[i] = document_id;
+		term_counts[i] = ReadVarint(data);
+	}
+	return header.size;
+}
+
+void PostingList::ReplaceBlock(size_t block, const std::vector<int>& document_ids, const std::vector<uint32_t>& term_counts,
+	double max_term_freq) {
+	const uint32_t offset = blocks_[block].offset;
+	const uint32_t position = blocks_[block].position;
+	const size_t old_end = block + 1 < blocks_.size() ? blocks_[block + 1].offset : bytes_.size();
+
+	std::vector<uint8_t> bytes;
+	std::vector<BlockHeader> headers;
+	for (size_t i = 0; i < document_ids.size(); ++i) {
+		if (i % BLOCK_SIZE == 0) {
+			headers.push_back({ document_ids[i], document_ids[i], static_cast<uint32_t>(offset + bytes.size()),
+				static_cast<uint32_t>(position + i), 0, 0, max_term_freq });
+		}
+		AppendVarint(bytes, static_cast<uint32_t>(document_ids[i] - headers.back().last_id));
+		AppendVarint(bytes, term_counts[i]);
+		headers.back().last_id = document_ids[i];
+		++headers.back().size;
+	}
+
+	std::vector<uint8_t>& all_bytes = bytes_.Mutable();
+	all_bytes.erase(all_bytes.begin() + offset, all_bytes.begin() + old_end);
+	all_bytes.insert(all_bytes.begin() + offset, bytes.begin(), bytes.end());
+	std::vector<BlockHeader>& blocks = blocks_.Mutable();
+	blocks.erase(blocks.begin() + block);
+	blocks.insert(blocks.begin() + block, headers.begin(), headers.end());
+
+	// Later blocks only shift
+	const int64_t shift = static_cast<int64_t>(bytes.size()) - static_cast<int64_t>(old_end - offset);
+	for (size_t i = block + headers.size(); i < blocks.size(); ++i) {
+		blocks[i].offset = static_cast<uint32_t>(blocks[i].offset + shift);
+		blocks[i].position = i == 0 ? 0 : blocks[i - 1].position + blocks[i - 1].size;
+	}
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+	: postings_(&postings) {
+	if (!postings.blocks_.empty()) {
+		postings.DecodeBlock(0, document_ids_.data(), term_counts_.data());
+	}
+}
+
+bool PostingList::Cursor::SeekTo(int document_id) {
+	const MappedArray<BlockHeader>& blocks = postings_->blocks_;
+	if (block_ < blocks.size() && blocks[block_].last_id < document_id) {
+		// Block headers tell which block holds the id, so the skipped ones are never decoded
+		block_ = std::partition_point(blocks.begin() + block_, blocks.end(),
+			[document_id](const BlockHeader& block) { return block.last_id < document_id; }) - blocks.begin();
+		index_ = 0;
+		if (block_ < blocks.size()) {
+			postings_->DecodeBlock(block_, document_ids_.data(), term_counts_.data());
+		}
+	}
+	if (block_ == blocks.size()) {
+		return false;
+	}
+	position_ = blocks[block_].position;
+	while (document_ids_[index_] < document_id) {
+		++index_;
+	}
+	return true;
+}
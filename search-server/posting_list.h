@@ -0,0 +1,126 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "mapped_array.h"
+
+class SnapshotWriter;
+class SnapshotReader;
+
+// Postings of a single term: sorted document ids with the number of times the term occurs.
+// Postings are compressed in blocks: ids as varint deltas, each followed by its varint count,
+// so a typical posting takes two or three bytes. Readers decode one block at a time.
+class PostingList {
+public:
+    // Upper limit of postings in a block; the blocks also carry per-block score bounds
+    inline static constexpr size_t BLOCK_SIZE = 128;
+
+    // term_freq is only used for the block bound; scoring rebuilds it from term_count.
+    // Adding an id that is already present adds term_count to it
+    void Add(int document_id, uint32_t term_count, double term_freq);
+
+    bool Contains(int document_id) const;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    // Largest term frequency among the postings with ids in [first_id, last_id)
+    // rounded out to whole blocks, so it may only overestimate
+    double GetMaxTermFreq(int first_id, int last_id) const;
+
+    // Bytes taken by the encoded postings and block headers
+    size_t GetMemoryUsage() const;
+
+    void SaveSnapshot(SnapshotWriter& writer) const;
+
+    // The loaded postings view the mapped file until the first change copies them. Every block is
+    // checked, so a damaged file throws std::runtime_error instead of being read out of bounds
+    void LoadSnapshot(SnapshotReader& reader);
+
+    // Whether every id lies in [first_id, last_id)
+    bool HasIdsWithin(int first_id, int last_id) const;
+
+    // Calls function(position, document_id, term_count) for every posting with id in [first_id, last_id).
+    // Position is the index of the posting in the whole list
+    template <typename Function>
+    void ForEach(int first_id, int last_id, Function function) const;
+
+    // Forward-only reader decoding one block at a time
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& postings);
+
+        // Moves to the first posting with id >= document_id; false when the list is exhausted
+        bool SeekTo(int document_id);
+
+        int GetDocumentId() const {
+            return document_ids_[index_];
+        }
+
+        uint32_t GetTermCount() const {
+            return term_counts_[index_];
+        }
+
+        size_t GetPosition() const {
+            return position_ + index_;
+        }
+
+    private:
+        const PostingList* postings_;
+        size_t block_ = 0;
+        size_t index_ = 0;
+        size_t position_ = 0;
+        std::array<int, BLOCK_SIZE> document_ids_;
+        std::array<uint32_t, BLOCK_SIZE> term_counts_;
+    };
+
+private:
+    struct BlockHeader {
+        int first_id;
+        int last_id;
+        // Start of the block in bytes_ and of its first posting in the list
+        uint32_t offset;
+        uint32_t position;
+        uint32_t size;
+        // The padding is a zeroed member, so snapshots, which store the headers raw, are deterministic
+        uint32_t padding = 0;
+        double max_term_freq;
+    };
+
+    MappedArray<uint8_t> bytes_;
+    MappedArray<BlockHeader> blocks_;
+    size_t size_ = 0;
+
+    // First block whose last id is not below document_id
+    size_t FindBlock(int document_id) const;
+
+    size_t DecodeBlock(size_t block, int* document_ids, uint32_t* term_counts) const;
+
+    // Replaces the block with the given postings, split into as many blocks as needed
+    void ReplaceBlock(size_t block, const std::vector<int>& document_ids, const std::vector<uint32_t>& term_counts,
+        double max_term_freq);
+};
+
+template <typename Function>
+void PostingList::ForEach(int first_id, int last_id, Function function) const {
+    std::array<int, BLOCK_SIZE> document_ids;
+    std::array<uint32_t, BLOCK_SIZE> term_counts;
+    for (size_t block = FindBlock(first_id); block < blocks_.size() && blocks_[block].first_id < last_id; ++block) {
+        const size_t count = DecodeBlock(block, document_ids.data(), term_counts.data());
+        for (size_t i = 0; i < count; ++i) {
+            if (document_ids[i] >= last_id) {
+                return;
+            }
+            if (document_ids[i] >= first_id) {
+                function(blocks_[block].position + i, document_ids[i], term_counts[i]);
+            }
+        }
+    }
+}
@@ -1,24 +1,50 @@
 #include "process_queries.h"
-#include <algorithm>
-#include<execution>
 
 
 std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueries(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
     std::vector<std::vector<Document>> process_queries(queries.size());
-    std::transform(std::execution::par,queries.begin(), queries.end(), process_queries.begin(), [&search_server](const std::string& str) { return search_server.FindTopDocuments(str); });
+    executor.ForEachIndex(queries.size(), [&](size_t i) { process_queries[i] = search_server.FindTopDocuments(queries[i]); });
     return process_queries;
 }
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    std::vector<std::vector<Document>> process_queries(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), process_queries.begin(), [&search_server](const std::string& str) { return search_server.FindTopDocuments(str); });
-    std::vector<Document> res;
-    for (auto&& doc : process_queries) {
-        res.insert(res.end(), doc.begin(), doc.end());
-    }
-    return res;
-}
\ No newline at end of file
+    return ProcessQueriesJoined(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+std::vector<Document> ProcessQueriesJoined(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    const JoinedDocuments joined = ProcessQueriesJoinedView(executor, search_server, queries);
+    return std::vector<Document>(joined.begin(), joined.end());
+}
+
+JoinedDocuments ProcessQueriesJoinedView(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesJoinedView(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+JoinedDocuments ProcessQueriesJoinedView(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    const size_t max_count = MAX_RESULT_DOCUMENT_COUNT;
+    std::unique_ptr<Document[]> buffer(new Document[queries.size() * max_count]);
+    std::vector<size_t> counts(queries.size());
+    executor.ForEachIndex(queries.size(), [&](size_t i) {
+        counts[i] = search_server.FindTopDocumentsInto(queries[i], buffer.get() + i * max_count, max_count);
+    });
+    return JoinedDocuments(std::move(buffer), max_count, std::move(counts));
+}
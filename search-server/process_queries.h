@@ -1,13 +1,144 @@
 #pragma once
 #include<vector>
 #include<string>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
 #include "search_server.h"
 #include "document.h"
+#include "query_executor.h"
+
+// Results of ProcessQueriesJoinedView in query order. Every query owns a slot of max_count documents
+// in one buffer and is searched straight into it; iteration skips the unused tail of each slot,
+// so the documents are never copied after the search
+class JoinedDocuments {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Document;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Document*;
+        using reference = const Document&;
+
+        // Value-initialized iterators compare equal to each other only
+        Iterator() = default;
+
+        Iterator(const JoinedDocuments* documents, size_t query, size_t index)
+            : documents_(documents)
+            , query_(query)
+            , index_(index) {
+            SkipEmptySlots();
+        }
+
+        reference operator*() const {
+            return documents_->buffer_[query_ * documents_->max_count_ + index_];
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator& operator++() {
+            ++index_;
+            SkipEmptySlots();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return query_ == other.query_ && index_ == other.index_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const JoinedDocuments* documents_ = nullptr;
+        size_t query_ = 0;
+        size_t index_ = 0;
+
+        void SkipEmptySlots() {
+            while (query_ < documents_->counts_.size() && index_ == documents_->counts_[query_]) {
+                ++query_;
+                index_ = 0;
+            }
+        }
+    };
+
+    // buffer holds counts.size() slots of max_count documents, counts[i] of them filled in the i-th slot
+    JoinedDocuments(std::unique_ptr<Document[]> buffer, size_t max_count, std::vector<size_t> counts)
+        : buffer_(std::move(buffer))
+        , max_count_(max_count)
+        , counts_(std::move(counts)) {
+        for (const size_t count : counts_) {
+            size_ += count;
+        }
+    }
+
+    Iterator begin() const {
+        return Iterator(this, 0, 0);
+    }
+
+    Iterator end() const {
+        return Iterator(this, counts_.size(), 0);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    // Documents found for one query, as a pointer range into the buffer
+    std::pair<const Document*, const Document*> GetQueryDocuments(size_t query) const {
+        const Document* first = buffer_.get() + query * max_count_;
+        return { first, first + counts_[query] };
+    }
+
+private:
+    std::unique_ptr<Document[]> buffer_;
+    size_t max_count_;
+    std::vector<size_t> counts_;
+    size_t size_ = 0;
+};
+
+// Queries run on the given executor, or on QueryExecutor::GetDefault() when none is passed.
+// Calls sharing an executor run one after another, so concurrent callers should pass executors of
+// their own; called from a thread of the executor, the queries run one by one on that thread
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
 
 std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
 std::vector<Document> ProcessQueriesJoined(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// ProcessQueriesJoined without the final copy: the documents stay in the buffer they were found into
+JoinedDocuments ProcessQueriesJoinedView(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+JoinedDocuments ProcessQueriesJoinedView(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    // Entries found but computed at an older index epoch; also counted as misses
+    uint64_t stale = 0;
+};
+
+// Thread-safe LRU map from a query string to a value computed at some index epoch.
+// Entries of an older epoch are treated as misses, so bumping the epoch invalidates
+// everything without touching the cache. Value should be cheap to copy, e.g. a shared_ptr
+template <typename Value>
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity = 0)
+        : capacity_(capacity) {
+    }
+
+    // Copies keep the capacity but start out empty
+    QueryCache(const QueryCache& other)
+        : capacity_(other.GetCapacity()) {
+    }
+
+    size_t GetCapacity() const {
+        std::lock_guard guard(mutex_);
+        return capacity_;
+    }
+
+    // Drops every entry and the counters
+    void SetCapacity(size_t capacity) {
+        std::lock_guard guard(mutex_);
+        capacity_ = capacity;
+        index_.clear();
+        entries_.clear();
+        stats_ = {};
+    }
+
+    std::optional<Value> Find(std::string_view key, uint64_t epoch) {
+        std::lock_guard guard(mutex_);
+        const auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++stats_.misses;
+            return std::nullopt;
+        }
+        if (it->second->epoch != epoch) {
+            ++stats_.misses;
+            ++stats_.stale;
+            entries_.erase(it->second);
+            index_.erase(it);
+            return std::nullopt;
+        }
+        ++stats_.hits;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->value;
+    }
+
+    void Insert(std::string_view key, uint64_t epoch, Value value) {
+        std::lock_guard guard(mutex_);
+        if (capacity_ == 0) {
+            return;
+        }
+        const auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->epoch = epoch;
+            it->second->value = std::move(value);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        if (entries_.size() == capacity_) {
+            ++stats_.evictions;
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+        }
+        entries_.push_front({ std::string(key), epoch, std::move(value) });
+        // The key view points into the list node, which never moves
+        index_.emplace(entries_.front().key, entries_.begin());
+    }
+
+    QueryCacheStats GetStats() const {
+        std::lock_guard guard(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t epoch;
+        Value value;
+    };
+
+    mutable std::mutex mutex_;
+    size_t capacity_;
+    // Most recently used first
+    std::list<Entry> entries_;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator> index_;
+    QueryCacheStats stats_;
+};
@@ -0,0 +1,189 @@
+#include "query_executor.h"
+#include <algorithm>
+
+namespace {
+
+// The executor whose batch or task the current thread is running, if any
+thread_local const QueryExecutor* current_executor = nullptr;
+
+class CurrentExecutorScope {
+public:
+	explicit CurrentExecutorScope(const QueryExecutor* executor)
+		: previous_(current_executor) {
+		current_executor = executor;
+	}
+
+	~CurrentExecutorScope() {
+		current_executor = previous_;
+	}
+
+private:
+	const QueryExecutor* previous_;
+};
+
+}
+
+QueryExecutor::QueryExecutor(size_t thread_count) {
+	thread_count = std::max<size_t>(thread_count, 1);
+	for (size_t i = 0; i < thread_count; ++i) {
+		workers_.push_back(std::make_unique<Worker>());
+	}
+	// Slot 0 belongs to the thread that starts the batch
+	for (size_t i = 1; i < std::max<size_t>(thread_count, 2); ++i) {
+		threads_.emplace_back([this, i] { WorkerLoop(i); });
+	}
+}
+
+QueryExecutor::~QueryExecutor() {
+	{
+		std::lock_guard lock(state_mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	for (std::thread& thread : threads_) {
+		thread.join();
+	}
+}
+
+QueryExecutor& QueryExecutor::GetDefault() {
+	static QueryExecutor executor;
+	return executor;
+}
+
+void QueryExecutor::Post(std::function<void()> task) {
+	{
+		std::lock_guard lock(state_mutex_);
+		tasks_.push_back(std::move(task));
+	}
+	wake_.notify_one();
+}
+
+void QueryExecutor::RunBatch(size_t count, const std::function<void(size_t)>& function) {
+	if (count == 0) {
+		return;
+	}
+	if (current_executor == this) {
+		// The pool may be busy with the batch this call is part of, so waiting for it never ends
+		for (size_t i = 0; i < count; ++i) {
+			function(i);
+		}
+		return;
+	}
+	std::lock_guard batch_lock(batch_mutex_);
+	const CurrentExecutorScope scope(this);
+	function_ = &function;
+	remaining_ = count;
+	failed_ = false;
+	error_ = nullptr;
+	// Contiguous ranges keep neighbouring queries on one thread until stealing kicks in
+	for (size_t i = 0; i < workers_.size(); ++i) {
+		std::lock_guard lock(workers_[i]->mutex);
+		workers_[i]->begin = count * i / workers_.size();
+		workers_[i]->end = count * (i + 1) / workers_.size();
+	}
+	{
+		std::lock_guard lock(state_mutex_);
+		++generation_;
+	}
+	wake_.notify_all();
+
+	Work(0);
+	{
+		// Workers that woke up late may still be looking for work, they must not outlive function
+		std::unique_lock lock(state_mutex_);
+		done_.wait(lock, [this] { return remaining_ == 0 && active_ == 0; });
+	}
+	function_ = nullptr;
+	if (error_) {
+		std::rethrow_exception(error_);
+	}
+}
+
+void QueryExecutor::WorkerLoop(size_t self) {
+	// The task thread of a single-slot executor has no range to work on
+	const bool runs_batches = self < workers_.size();
+	const CurrentExecutorScope scope(this);
+	uint64_t generation = 0;
+	std::unique_lock lock(state_mutex_);
+	while (true) {
+		const auto has_batch = [&] { return runs_batches && generation_ != generation; };
+		wake_.wait(lock, [&] { return stopping_ || has_batch() || !tasks_.empty(); });
+		// Batches go first: their caller is blocked until every index is done
+		if (!has_batch() && !tasks_.empty()) {
+			std::function<void()> task = std::move(tasks_.front());
+			tasks_.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+			continue;
+		}
+		// Queued tasks still run on shutdown, so none of their futures is left broken
+		if (stopping_) {
+			return;
+		}
+		generation = generation_;
+		++active_;
+		lock.unlock();
+		Work(self);
+		lock.lock();
+		if (--active_ == 0) {
+			done_.notify_all();
+		}
+	}
+}
+
+void QueryExecutor::Work(size_t self) {
+	size_t index;
+	while (TakeOwn(self, index) || Steal(self, index)) {
+		if (!failed_) {
+			try {
+				(*function_)(index);
+			}
+			catch (...) {
+				std::lock_guard lock(state_mutex_);
+				if (!failed_.exchange(true)) {
+					error_ = std::current_exception();
+				}
+			}
+		}
+		if (remaining_.fetch_sub(1) == 1) {
+			std::lock_guard lock(state_mutex_);
+			done_.notify_all();
+		}
+	}
+}
+
+bool QueryExecutor::TakeOwn(size_t self, size_t& index) {
+	Worker& worker = *workers_[self];
+	std::lock_guard lock(worker.mutex);
+	if (worker.begin == worker.end) {
+		return false;
+	}
+	index = worker.begin++;
+	return true;
+}
+
+bool QueryExecutor::Steal(size_t self, size_t& index) {
+	for (size_t i = 1; i < workers_.size(); ++i) {
+		Worker& victim = *workers_[(self + i) % workers_.size()];
+		size_t begin;
+		size_t end;
+		{
+			std::lock_guard lock(victim.mutex);
+			if (victim.begin == victim.end) {
+				continue;
+			}
+			// The back half, so the victim keeps the indexes next to the one it is running
+			begin = victim.begin + (victim.end - victim.begin) / 2;
+			end = victim.end;
+			victim.end = begin;
+		}
+		Worker& worker = *workers_[self];
+		std::lock_guard lock(worker.mutex);
+		worker.begin = begin + 1;
+		worker.end = end;
+		index = begin;
+		return true;
+	}
+	return false;
+}
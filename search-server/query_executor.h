@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent thread pool for batches of independent queries.
+// Every worker owns a range of the batch and takes indexes from its front; an idle worker
+// steals the back half of another worker's range, so a few expensive queries do not leave
+// the other threads waiting. Threads live as long as the executor, so their thread_local
+// scratch space (relevance accumulators) stays allocated between batches
+class QueryExecutor {
+public:
+    // The calling thread takes part in every batch, so thread_count - 1 threads are started;
+    // with thread_count 1 one thread is still started for posted tasks
+    explicit QueryExecutor(size_t thread_count = std::thread::hardware_concurrency());
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    ~QueryExecutor();
+
+    size_t GetThreadCount() const {
+        return workers_.size();
+    }
+
+    // Calls function(index) for every index in [0, count) and returns when all calls have finished.
+    // The first exception thrown is rethrown here, the remaining indexes are skipped.
+    // Batches from different threads run one after another, so callers that must not wait for each
+    // other need executors of their own. Called from a thread of this executor (inside a batch
+    // function or a posted task), the batch runs inline on that thread instead of deadlocking
+    template <typename Function>
+    void ForEachIndex(size_t count, Function function) {
+        RunBatch(count, std::function<void(size_t)>(std::ref(function)));
+    }
+
+    // Queues task for the pool threads, which take queued tasks between batches.
+    // task must not throw; wrap it in a std::packaged_task to get its result or exception
+    void Post(std::function<void()> task);
+
+    // Shared executor with one thread per core
+    static QueryExecutor& GetDefault();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex batch_mutex_;
+    std::mutex state_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    size_t active_ = 0;
+    bool stopping_ = false;
+    std::deque<std::function<void()>> tasks_;
+
+    const std::function<void(size_t)>* function_ = nullptr;
+    std::atomic<size_t> remaining_ = 0;
+    std::atomic<bool> failed_ = false;
+    std::exception_ptr error_;
+
+    void RunBatch(size_t count, const std::function<void(size_t)>& function);
+
+    void WorkerLoop(size_t self);
+
+    // Runs indexes of the current batch until no worker has any left
+    void Work(size_t self);
+
+    bool TakeOwn(size_t self, size_t& index);
+
+    bool Steal(size_t self, size_t& index);
+};
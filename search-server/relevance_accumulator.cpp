@@ -0,0 +1,25 @@
+#include "relevance_accumulator.h"
+#include <algorithm>
+
+RelevanceAccumulator& RelevanceAccumulator::ForCurrentThread() {
+	thread_local RelevanceAccumulator accumulator;
+	return accumulator;
+}
+
+void RelevanceAccumulator::Reset(size_t document_count) {
+	if (relevances_.size() < document_count) {
+		relevances_.resize(document_count);
+		generations_.resize(document_count, generation_);
+		excluded_.resize((document_count + 63) / 64);
+	}
+	if (++generation_ == 0) {
+		// The counter wrapped around, stale stamps could look current again
+		std::fill(generations_.begin(), generations_.end(), 0);
+		generation_ = 1;
+	}
+	touched_.clear();
+	for (const size_t word : excluded_words_) {
+		excluded_[word] = 0;
+	}
+	excluded_words_.clear();
+}
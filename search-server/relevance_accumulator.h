@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Dense per-query relevance scores indexed by document ordinal.
+// Slots are invalidated by bumping a generation counter and minus words are
+// kept in a bitmap, so Reset costs only what the previous query touched
+class RelevanceAccumulator {
+public:
+    // One accumulator per thread, reused by every query that thread runs
+    static RelevanceAccumulator& ForCurrentThread();
+
+    void Reset(size_t document_count);
+
+    void Exclude(int ordinal) {
+        uint64_t& word = excluded_[ordinal / 64];
+        if (word == 0) {
+            excluded_words_.push_back(ordinal / 64);
+        }
+        word |= uint64_t{ 1 } << (ordinal % 64);
+    }
+
+    bool IsExcluded(int ordinal) const {
+        return (excluded_[ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    void Add(int ordinal, double relevance) {
+        if (generations_[ordinal] != generation_) {
+            generations_[ordinal] = generation_;
+            relevances_[ordinal] = 0.0;
+            touched_.push_back(ordinal);
+        }
+        relevances_[ordinal] += relevance;
+    }
+
+    bool IsTouched(int ordinal) const {
+        return generations_[ordinal] == generation_;
+    }
+
+    double GetRelevance(int ordinal) const {
+        return relevances_[ordinal];
+    }
+
+    // Ordinals that received a score since the last Reset
+    const std::vector<int>& GetTouched() const {
+        return touched_;
+    }
+
+private:
+    std::vector<double> relevances_;
+    std::vector<uint32_t> generations_;
+    uint32_t generation_ = 0;
+    std::vector<int> touched_;
+    std::vector<uint64_t> excluded_;
+    std::vector<size_t> excluded_words_;
+};
@@ -0,0 +1,127 @@
+#include "remote_sharded_search_server.h"
+#include "sharded_search_server.h"
+#include <map>
+#include <stdexcept>
+
+RemoteShardedSearchServer::RemoteShardedSearchServer(const std::vector<std::string>& socket_paths) {
+	if (socket_paths.empty()) {
+		throw std::invalid_argument("no shards");
+	}
+	for (const std::string& path : socket_paths) {
+		shards_.push_back(UnixSocket::Connect(path));
+	}
+	responses_.resize(shards_.size());
+}
+
+std::vector<Document> RemoteShardedSearchServer::FindTopDocuments(std::string_view raw_query, size_t max_count) const {
+	std::lock_guard lock(mutex_);
+	CheckConnection();
+
+	MessageWriter statistics_request;
+	statistics_request.Write(ShardRequest::STATISTICS);
+	statistics_request.WriteString(raw_query);
+	Broadcast(statistics_request);
+	int document_count = 0;
+	std::map<std::string, int, std::less<>> document_freqs;
+	for (size_t shard = 0; shard < shards_.size(); ++shard) {
+		MessageReader reader = OpenResponse(shard);
+		document_count += reader.Read<int32_t>();
+		for (uint32_t i = reader.Read<uint32_t>(); i > 0; --i) {
+			const std::string_view word = reader.ReadString();
+			const int document_freq = reader.Read<int32_t>();
+			document_freqs[std::string(word)] += document_freq;
+		}
+	}
+
+	MessageWriter request;
+	request.Write(ShardRequest::FIND_TOP_DOCUMENTS);
+	request.WriteString(raw_query);
+	request.Write<uint64_t>(max_count);
+	request.Write<int32_t>(document_count);
+	request.Write<uint32_t>(static_cast<uint32_t>(document_freqs.size()));
+	for (const auto& [word, document_freq] : document_freqs) {
+		request.WriteString(word);
+		request.Write<int32_t>(document_freq);
+	}
+	Broadcast(request);
+	TopDocuments top_documents(max_count);
+	for (size_t shard = 0; shard < shards_.size(); ++shard) {
+		MessageReader reader = OpenResponse(shard);
+		for (uint32_t i = reader.Read<uint32_t>(); i > 0; --i) {
+			const int id = reader.Read<int32_t>();
+			const double relevance = reader.Read<double>();
+			top_documents.Add({ id, relevance, reader.Read<int32_t>() });
+		}
+	}
+	return top_documents.Build();
+}
+
+std::tuple<std::vector<std::string>, DocumentStatus> RemoteShardedSearchServer::MatchDocument(std::string_view raw_query,
+	int document_id) const {
+	std::lock_guard lock(mutex_);
+	CheckConnection();
+	MessageWriter request;
+	request.Write(ShardRequest::MATCH_DOCUMENT);
+	request.WriteString(raw_query);
+	request.Write<int32_t>(document_id);
+	const size_t shard = GetShardIndex(document_id, shards_.size());
+	try {
+		shards_[shard].SendMessage(request.GetBytes());
+		Receive(shard);
+	}
+	catch (...) {
+		broken_ = true;
+		throw;
+	}
+
+	MessageReader reader = OpenResponse(shard);
+	std::vector<std::string> words(reader.Read<uint32_t>());
+	for (std::string& word : words) {
+		word = reader.ReadString();
+	}
+	return { words, static_cast<DocumentStatus>(reader.Read<int32_t>()) };
+}
+
+void RemoteShardedSearchServer::Broadcast(const MessageWriter& request) const {
+	// Shards that got the request before a failure would answer into the next call
+	try {
+		for (UnixSocket& shard : shards_) {
+			shard.SendMessage(request.GetBytes());
+		}
+		for (size_t shard = 0; shard < shards_.size(); ++shard) {
+			Receive(shard);
+		}
+	}
+	catch (...) {
+		broken_ = true;
+		throw;
+	}
+}
+
+void RemoteShardedSearchServer::CheckConnection() const {
+	if (broken_) {
+		throw std::runtime_error("connection to the shards was lost");
+	}
+}
+
+void RemoteShardedSearchServer::Receive(size_t shard) const {
+	if (!shards_[shard].ReceiveMessage(responses_[shard])) {
+		throw std::runtime_error("shard closed the connection");
+	}
+}
+
+MessageReader RemoteShardedSearchServer::OpenResponse(size_t shard) const {
+	MessageReader reader(responses_[shard]);
+	const ShardStatus status = reader.Read<ShardStatus>();
+	if (status == ShardStatus::OK) {
+		return reader;
+	}
+	const std::string message(reader.ReadString());
+	if (status == ShardStatus::INVALID_ARGUMENT) {
+		throw std::invalid_argument(message);
+	}
+	if (status == ShardStatus::OUT_OF_RANGE) {
+		throw std::out_of_range(message);
+	}
+	throw std::runtime_error(message);
+}
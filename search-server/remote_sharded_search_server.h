@@ -0,0 +1,50 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "shard_protocol.h"
+
+// Front end of shard processes running ShardService, one socket per shard in shard order.
+// Documents are expected on the shard GetShardIndex picks, as ShardedSearchServer places them.
+// A query sends its requests to every shard before reading any answer, so the shards work in
+// parallel. Calls are serialized; use one front end per client thread for parallel queries.
+// A failed send or receive leaves responses unaccounted for, so after one every call throws
+// std::runtime_error; connect a new front end to recover
+class RemoteShardedSearchServer {
+public:
+    // Connects to every shard; throws std::runtime_error if one can't be reached
+    explicit RemoteShardedSearchServer(const std::vector<std::string>& socket_paths);
+
+    // Results and exceptions of SearchServer::FindTopDocuments(raw_query) on the whole collection.
+    // Shards first report their document frequencies, then score with the global ones
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    size_t GetShardCount() const {
+        return shards_.size();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::vector<UnixSocket> shards_;
+    mutable std::vector<std::vector<char>> responses_;
+    // Set when a transport error may have left the shards out of step with the requests
+    mutable bool broken_ = false;
+
+    void CheckConnection() const;
+
+    // Sends request to every shard and receives every response, so that an error of one shard
+    // leaves no unread response on the others
+    void Broadcast(const MessageWriter& request) const;
+
+    void Receive(size_t shard) const;
+
+    // Reader of the received response past its status; throws the exception the shard reported
+    MessageReader OpenResponse(size_t shard) const;
+};
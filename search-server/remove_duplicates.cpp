@@ -1,27 +1,200 @@
 #include "remove_duplicates.h"
-#include <set>
-#include <string>
-#include<algorithm>
-#include <utility>
-#include<iterator>
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
 
-void RemoveDuplicates(SearchServer& search_server) {
-    std::set<int> remove_ids;
-    std::set<std::set<std::string_view>> word_to_ids;
+namespace {
+
+// splitmix64 finalizer: every input bit affects every output bit
+uint64_t Mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
 
-    for (const int document_id : search_server) {
-        const auto word_map = search_server.GetWordFrequencies(document_id);
-        std::set<std::string_view> key_for_map;
+uint64_t ComputeFingerprint(const std::vector<uint32_t>& term_ids) {
+    uint64_t fingerprint = Mix(term_ids.size());
+    for (const uint32_t term_id : term_ids) {
+        fingerprint = Mix(fingerprint ^ term_id);
+    }
+    return fingerprint;
+}
 
-        std::transform(word_map.cbegin(), word_map.cend(), std::inserter(key_for_map, key_for_map.begin()), [](const std::pair<std::string_view, double>& pair) {return pair.first; });
+// |lhs n rhs| / |lhs u rhs| of sorted term ids; 1 for two empty sets, which RemoveDuplicates treats as equal
+double ComputeJaccardSimilarity(const std::vector<uint32_t>& lhs, const std::vector<uint32_t>& rhs) {
+    size_t common = 0;
+    for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        } else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        } else {
+            ++common;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    const size_t total = lhs.size() + rhs.size() - common;
+    return total == 0 ? 1.0 : static_cast<double>(common) / total;
+}
 
-        if (word_to_ids.count(key_for_map))
-            remove_ids.insert(document_id);
-        else word_to_ids.insert(key_for_map);
+// One-permutation MinHash: every term is hashed once and goes to one of band_count * rows_per_band bins,
+// each bin keeping its smallest hash. That costs O(terms + bins) per document instead of a hash function
+// per value. Each signature is reduced right away to one bucket key per band, so it is never stored
+class MinHasher {
+public:
+    explicit MinHasher(const NearDuplicateOptions& options)
+        : band_count_(options.band_count)
+        , rows_per_band_(options.rows_per_band) {
+    }
+
+    void ComputeBandKeys(const std::vector<uint32_t>& term_ids, uint64_t* band_keys) const {
+        const size_t bin_count = band_count_ * rows_per_band_;
+        std::vector<uint32_t> bins(bin_count, EMPTY);
+        for (const uint32_t term_id : term_ids) {
+            const uint64_t term_hash = Mix(term_id);
+            const size_t bin = static_cast<size_t>(((term_hash >> 32) * bin_count) >> 32);
+            // EMPTY itself is never stored, so a filled bin always stays filled
+            bins[bin] = std::min({ bins[bin], static_cast<uint32_t>(term_hash), EMPTY - 1 });
+        }
+        // Short documents leave most bins empty. An empty bin takes the value of a filled bin picked by a
+        // sequence of hashes that depends only on the empty bin, so two documents agree on it with the same
+        // probability as on a filled one, and a run of empty bins doesn't copy a single value
+        std::vector<uint32_t> signature = bins;
+        if (!term_ids.empty()) {
+            for (size_t bin = 0; bin < bin_count; ++bin) {
+                for (uint64_t attempt = 1; signature[bin] == EMPTY; ++attempt) {
+                    const uint64_t source = ((Mix(bin << 32 | attempt) >> 32) * bin_count) >> 32;
+                    signature[bin] = bins[source];
+                }
+            }
+        }
+
+        for (size_t band = 0; band < band_count_; ++band) {
+            // Equal rows in different bands must not share a bucket
+            uint64_t key = Mix(band);
+            for (size_t row = 0; row < rows_per_band_; ++row) {
+                key = Mix(key ^ signature[band * rows_per_band_ + row]);
+            }
+            band_keys[band] = key;
+        }
+    }
+
+private:
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+    size_t band_count_;
+    size_t rows_per_band_;
+};
+
+}
+
+void RemoveDuplicates(SearchServer& search_server) {
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<uint64_t> fingerprints(document_ids.size());
+    std::transform(std::execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(),
+        [&search_server](int document_id) { return ComputeFingerprint(search_server.GetDocumentTermIds(document_id)); });
+
+    // Fingerprint -> the kept documents having it; more than one only after a collision
+    std::unordered_map<uint64_t, std::vector<int>> originals;
+    originals.reserve(document_ids.size());
+    std::vector<int> remove_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        std::vector<int>& same_fingerprint = originals[fingerprints[i]];
+        bool is_duplicate = false;
+        if (!same_fingerprint.empty()) {
+            const std::vector<uint32_t> term_ids = search_server.GetDocumentTermIds(document_ids[i]);
+            is_duplicate = std::any_of(same_fingerprint.begin(), same_fingerprint.end(),
+                [&search_server, &term_ids](int original_id) { return search_server.GetDocumentTermIds(original_id) == term_ids; });
+        }
+        if (is_duplicate) {
+            remove_ids.push_back(document_ids[i]);
+        } else {
+            same_fingerprint.push_back(document_ids[i]);
+        }
     }
 
     for (const int id : remove_ids) {
         search_server.RemoveDocument(id);
     }
+}
+
+std::vector<NearDuplicate> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    if (!(options.jaccard_threshold > 0.0 && options.jaccard_threshold <= 1.0)) {
+        throw std::invalid_argument("Jaccard threshold must be in (0, 1]");
+    }
+    if (options.band_count == 0 || options.rows_per_band == 0) {
+        throw std::invalid_argument("MinHash needs at least one band and one row");
+    }
+    const size_t band_count = options.band_count;
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    const MinHasher hasher(options);
+    std::vector<uint64_t> band_keys(document_ids.size() * band_count);
+    std::vector<size_t> indexes(document_ids.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+        [&search_server, &document_ids, &hasher, &band_keys, band_count](size_t i) {
+            hasher.ComputeBandKeys(search_server.GetDocumentTermIds(document_ids[i]), band_keys.data() + i * band_count);
+        });
+
+    // Band key -> the last kept document put in that bucket; next_in_bucket[i * band_count + band] links
+    // to the one before it. Duplicates stay out of the buckets, so a bucket only grows with
+    // documents that are dissimilar to each other
+    constexpr size_t NO_DOCUMENT = std::numeric_limits<size_t>::max();
+    std::unordered_map<uint64_t, size_t> bucket_heads;
+    bucket_heads.reserve(document_ids.size() * band_count);
+    std::vector<size_t> next_in_bucket(document_ids.size() * band_count, NO_DOCUMENT);
+    std::vector<NearDuplicate> duplicates;
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const uint64_t* keys = band_keys.data() + i * band_count;
+        candidates.clear();
+        for (size_t band = 0; band < band_count; ++band) {
+            if (const auto head_it = bucket_heads.find(keys[band]); head_it != bucket_heads.end()) {
+                for (size_t j = head_it->second; j != NO_DOCUMENT; j = next_in_bucket[j * band_count + band]) {
+                    candidates.push_back(j);
+                }
+            }
+        }
+        // Ascending indexes make the smallest similar id the original
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
 
-}
\ No newline at end of file
+        bool is_duplicate = false;
+        if (!candidates.empty()) {
+            const std::vector<uint32_t> term_ids = search_server.GetDocumentTermIds(document_ids[i]);
+            for (const size_t candidate : candidates) {
+                const double similarity =
+                    ComputeJaccardSimilarity(term_ids, search_server.GetDocumentTermIds(document_ids[candidate]));
+                if (similarity >= options.jaccard_threshold) {
+                    duplicates.push_back({ document_ids[i], document_ids[candidate], similarity });
+                    is_duplicate = true;
+                    break;
+                }
+            }
+        }
+        if (!is_duplicate) {
+            for (size_t band = 0; band < band_count; ++band) {
+                const auto [head_it, inserted] = bucket_heads.try_emplace(keys[band], i);
+                if (!inserted) {
+                    next_in_bucket[i * band_count + band] = head_it->second;
+                    head_it->second = i;
+                }
+            }
+        }
+    }
+    return duplicates;
+}
+
+std::vector<NearDuplicate> RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    std::vector<NearDuplicate> duplicates = FindNearDuplicates(search_server, options);
+    for (const NearDuplicate& duplicate : duplicates) {
+        search_server.RemoveDocument(duplicate.document_id);
+    }
+    return duplicates;
+}
@@ -1,4 +1,37 @@
 #pragma once
 #include "search_server.h"
 
+// Removes every document whose set of words equals that of a document with a smaller id.
+// Documents are fingerprinted in parallel by a 64-bit hash of their sorted term ids, and
+// the word sets are only compared when fingerprints collide
 void RemoveDuplicates(SearchServer& search_server);
+
+struct NearDuplicateOptions {
+    // Documents are near duplicates when |A n B| / |A u B| of their word sets reaches this
+    double jaccard_threshold = 0.8;
+    // MinHash signatures have band_count * rows_per_band values. A pair becomes a candidate when
+    // all rows of some band agree, which happens mostly for similarity above
+    // (1 / band_count) ^ (1 / rows_per_band); keep that below the threshold
+    size_t band_count = 16;
+    size_t rows_per_band = 8;
+};
+
+struct NearDuplicate {
+    int document_id;
+    // Kept document with a smaller id that document_id is similar to
+    int original_id;
+    // Exact Jaccard similarity of the word sets
+    double similarity;
+};
+
+// Documents whose word sets are at least options.jaccard_threshold similar to a document with a
+// smaller id, in id order. Signatures are computed in parallel and bucketed band by band, so only
+// pairs sharing a bucket are compared; a pair can be missed with a probability that falls quickly
+// with its similarity. Each document is compared with the kept ones only. Throws
+// std::invalid_argument for a threshold outside (0, 1] and for zero bands or rows
+std::vector<NearDuplicate> FindNearDuplicates(const SearchServer& search_server,
+    const NearDuplicateOptions& options = NearDuplicateOptions());
+
+// Removes the documents FindNearDuplicates reports and returns them
+std::vector<NearDuplicate> RemoveNearDuplicates(SearchServer& search_server,
+    const NearDuplicateOptions& options = NearDuplicateOptions());
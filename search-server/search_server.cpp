@@ -1,49 +1,216 @@
 #include "search_server.h"
+#include "snapshot.h"
 #include <math.h>
+#include <cmath>
 #include<numeric>
 #include <execution>
 #include<iostream>
+#include <unordered_map>
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
 	const std::vector<int>& ratings) {
-	const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
-	QueryWord query_word;
-	if (documents_.count(document_id) != 0 || document_id < 0) {
+	bool has_control_chars = false;
+	const std::vector<std::string_view> words = SplitIntoWordsNoStop(document, has_control_chars);
+	if (document_ordinals_.count(document_id) != 0 || document_id < 0) {
 		throw std::invalid_argument("inappropriate id");
 	}
+	// Validate every word before the index is touched, so a bad document leaves no trace
+	for (const std::string_view word : words) {
+		ParseQueryWord(word, has_control_chars);
+	}
 
-	const double inv_word_count = 1.0 / words.size();
-
-	for (const std::string_view word :words) {
-		auto [it, _] = all_words_.emplace(word);
-		query_word = ParseQueryWord(word);
-		ids_to_word_freq_[document_id][*it] += inv_word_count;
-		word_to_document_freqs_[*it][document_id] += inv_word_count;
+	std::vector<uint32_t> term_ids;
+	term_ids.reserve(words.size());
+	for (const std::string_view word : words) {
+		term_ids.push_back(terms_.Intern(word));
 	}
-	documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-	ids_.emplace(document_id);
+	std::sort(term_ids.begin(), term_ids.end());
+	std::vector<TermCount> term_counts;
+	for (const uint32_t term_id : term_ids) {
+		if (term_counts.empty() || term_counts.back().term_id != term_id) {
+			term_counts.push_back({ term_id, 0 });
+		}
+		++term_counts.back().count;
+	}
+	AppendDocument(document_id, term_counts.data(), term_counts.data() + term_counts.size(), words.size(), status,
+		ComputeAverageRating(ratings));
+}
+
+std::vector<SearchServer::AddResult> SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+	return AddDocuments(std::execution::seq, documents);
+}
+
+std::vector<SearchServer::AddResult> SearchServer::AddDocuments(std::execution::sequenced_policy,
+	const std::vector<NewDocument>& documents) {
+	return MergePreparedDocuments(documents, { PrepareDocuments(documents.data(), documents.data() + documents.size()) });
 }
 
+std::vector<SearchServer::AddResult> SearchServer::AddDocuments(std::execution::parallel_policy,
+	const std::vector<NewDocument>& documents) {
+	const size_t part_count = std::max<size_t>(1, std::min(parallelism_, documents.size()));
+	std::vector<PreparedDocuments> parts(part_count);
+	std::vector<size_t> part_indexes(part_count);
+	std::iota(part_indexes.begin(), part_indexes.end(), 0);
+	// Parts only read the server, the merge is the one writer
+	std::for_each(std::execution::par, part_indexes.begin(), part_indexes.end(),
+		[this, &documents, &parts, part_count](size_t part) {
+			const NewDocument* first = documents.data() + documents.size() * part / part_count;
+			const NewDocument* last = documents.data() + documents.size() * (part + 1) / part_count;
+			parts[part] = PrepareDocuments(first, last);
+		});
+	return MergePreparedDocuments(documents, parts);
+}
 
 void SearchServer::RemoveDocument(int document_id) {
-	if (ids_to_word_freq_.count(document_id)) {
-		for (const auto& [word, _] : ids_to_word_freq_[document_id]) {
-			word_to_document_freqs_.at(word).erase(document_id);
+	const auto ordinal_it = document_ordinals_.find(document_id);
+	if (ordinal_it == document_ordinals_.end()) {
+		return;
+	}
+	const int ordinal = ordinal_it->second;
+	if (removed_ordinals_.size() <= static_cast<size_t>(ordinal) / 64) {
+		removed_ordinals_.resize(document_ids_.size() / 64 + 1);
+	}
+	removed_ordinals_[ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+	++removed_document_count_;
+	// The document frequencies the idf needs stay exact without touching the posting lists
+	if (removed_postings_.size() < postings_.size()) {
+		removed_postings_.resize(postings_.size());
+	}
+	const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal);
+	for (auto it = terms_begin; it != terms_end; ++it) {
+		++removed_postings_[it->term_id];
+	}
+	document_ordinals_.erase(ordinal_it);
+	++index_epoch_;
+	InvalidateScoringTables();
+}
+
+void SearchServer::Compact() {
+	if (removed_document_count_ == 0) {
+		return;
+	}
+	SearchServer compacted = BuildCompacted();
+	terms_ = std::move(compacted.terms_);
+	postings_ = std::move(compacted.postings_);
+	document_ordinals_ = std::move(compacted.document_ordinals_);
+	document_ids_ = std::move(compacted.document_ids_);
+	document_inverse_lengths_ = std::move(compacted.document_inverse_lengths_);
+	document_ratings_ = std::move(compacted.document_ratings_);
+	document_statuses_ = std::move(compacted.document_statuses_);
+	document_terms_ = std::move(compacted.document_terms_);
+	document_term_offsets_ = std::move(compacted.document_term_offsets_);
+	// Nothing views a loaded snapshot anymore
+	snapshot_file_.reset();
+	removed_ordinals_.clear();
+	removed_ordinals_.shrink_to_fit();
+	removed_document_count_ = 0;
+	removed_postings_.clear();
+	removed_postings_.shrink_to_fit();
+	// Term ids and ordinals changed, so cached query plans are stale as well
+	++index_epoch_;
+	InvalidateScoringTables();
+}
+
+int SearchServer::GetRemovedDocumentCount() const {
+	return static_cast<int>(removed_document_count_);
+}
+
+SearchServer SearchServer::BuildCompacted() const {
+	SearchServer compacted(stop_words_);
+	compacted.AddDocumentsFrom(*this);
+	return compacted;
+}
+
+void SearchServer::AddDocumentsFrom(const SearchServer& other) {
+	AddDocumentsFrom(other, [](int) {
+		return true;
+		});
+}
+
+void SearchServer::AddDocumentsFrom(const SearchServer& other, const std::function<bool(int document_id)>& document_filter) {
+	if (other.stop_words_ != stop_words_) {
+		throw std::invalid_argument("different stop words");
+	}
+	for (const auto [document_id, ordinal] : other.document_ordinals_) {
+		if (document_filter(document_id) && document_ordinals_.count(document_id) != 0) {
+			throw std::invalid_argument("inappropriate id");
+		}
+	}
+	// Terms are interned on first use, so words only other's removed documents had are left out
+	std::vector<uint32_t> term_ids(other.terms_.size(), TermDictionary::NO_TERM);
+	std::vector<TermCount> term_counts;
+	for (const auto [document_id, ordinal] : other.document_ordinals_) {
+		if (!document_filter(document_id)) {
+			continue;
 		}
-		ids_to_word_freq_.erase(document_id);
-		ids_.erase(ids_.find(document_id));
-		documents_.erase(document_id);
+		// The forward index keeps frequencies; counts and lengths are exact multiples of them
+		const size_t word_count = std::lround(1.0 / other.document_inverse_lengths_[ordinal]);
+		const auto [terms_begin, terms_end] = other.GetDocumentTerms(ordinal);
+		term_counts.clear();
+		for (auto it = terms_begin; it != terms_end; ++it) {
+			uint32_t& term_id = term_ids[it->term_id];
+			if (term_id == TermDictionary::NO_TERM) {
+				term_id = terms_.Intern(other.terms_.GetTerm(it->term_id));
+			}
+			term_counts.push_back({ term_id, static_cast<uint32_t>(std::lround(it->term_freq * word_count)) });
+		}
+		std::sort(term_counts.begin(), term_counts.end(),
+			[](const TermCount& lhs, const TermCount& rhs) { return lhs.term_id < rhs.term_id; });
+		AppendDocument(document_id, term_counts.data(), term_counts.data() + term_counts.size(), word_count,
+			other.document_statuses_[ordinal], other.document_ratings_[ordinal]);
 	}
+}
+
+
 
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+	size_t max_count) const {
+	return FindTopDocuments(std::execution::seq, raw_query, status, max_count);
 }
 
+size_t SearchServer::FindTopDocumentsInto(std::string_view raw_query, Document* output, size_t max_count) const {
+	if (cache_query_results_) {
+		const std::vector<Document> documents = FindTopDocuments(raw_query, DocumentStatus::ACTUAL, max_count);
+		std::copy(documents.begin(), documents.end(), output);
+		return documents.size();
+	}
+	const std::shared_ptr<const Query> query = GetQueryPlan(raw_query);
+	EnsureScoringTables();
+	// The heap lives in output, so the documents are sorted where the caller wants them
+	TopDocuments top_documents(output, max_count);
+	FindAllDocuments(std::execution::seq, *query, [](int, DocumentStatus status, int) {
+		return status == DocumentStatus::ACTUAL;
+		}, top_documents);
+	return top_documents.BuildInPlace();
+}
 
+SearchServer::QueryResult SearchServer::FindTopDocuments(std::string_view raw_query, const CancellationToken& token,
+	size_t max_count) const {
+	QueryResult result;
+	if (token.IsCancelled()) {
+		result.complete = false;
+		return result;
+	}
+	const std::shared_ptr<const Query> query = GetQueryPlan(raw_query);
+	EnsureScoringTables();
+	TopDocuments top_documents(max_count);
+	result.complete = FindAllDocuments(std::execution::seq, *query, [](int, DocumentStatus status, int) {
+		return status == DocumentStatus::ACTUAL;
+		}, top_documents, &token);
+	result.documents = top_documents.Build();
+	return result;
+}
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(std::execution::seq,
-		raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-			return document_status == status;
+std::future<SearchServer::QueryResult> SearchServer::FindTopDocumentsAsync(std::string_view raw_query, CancellationToken token,
+	size_t max_count, QueryExecutor& executor) const {
+	// packaged_task is move-only and Post takes a copyable function
+	auto task = std::make_shared<std::packaged_task<QueryResult()>>(
+		[this, query = std::string(raw_query), token = std::move(token), max_count]() {
+			return FindTopDocuments(query, token, max_count);
 		});
+	std::future<QueryResult> result = task->get_future();
+	executor.Post([task]() { (*task)(); });
+	return result;
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
@@ -51,7 +218,67 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query)
 }
 
 int SearchServer::GetDocumentCount() const {
-	return documents_.size();
+	return document_ordinals_.size();
+}
+
+bool SearchServer::ContainsDocument(int document_id) const {
+	return document_ordinals_.count(document_id) != 0;
+}
+
+int SearchServer::GetDocumentFreq(std::string_view word) const {
+	const uint32_t term_id = terms_.Find(word);
+	// Stop words are never interned
+	return term_id < postings_.size() ? static_cast<int>(GetLiveDocumentFreq(term_id)) : 0;
+}
+
+SearchServer::CollectionStatistics SearchServer::GetCollectionStatistics(std::vector<const SearchServer*> servers) {
+	CollectionStatistics statistics;
+	for (const SearchServer* server : servers) {
+		statistics.document_count += server->GetDocumentCount();
+	}
+	statistics.document_freq = [servers = std::move(servers)](std::string_view word) {
+		int document_freq = 0;
+		for (const SearchServer* server : servers) {
+			document_freq += server->GetDocumentFreq(word);
+		}
+		return document_freq;
+	};
+	return statistics;
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const CollectionStatistics& statistics,
+	size_t max_count) const {
+	return FindTopDocuments(raw_query, statistics, [](int, DocumentStatus status, int) {
+		return status == DocumentStatus::ACTUAL;
+		}, max_count);
+}
+
+void SearchServer::SetParallelism(size_t parallelism) {
+	parallelism_ = std::max<size_t>(parallelism, 1);
+}
+
+void SearchServer::SetPrecomputedImpacts(bool enabled) {
+	precomputed_impacts_ = enabled;
+	InvalidateScoringTables();
+}
+
+void SearchServer::SetDynamicPruning(bool enabled) {
+	dynamic_pruning_ = enabled;
+}
+
+void SearchServer::SetQueryCache(size_t capacity, bool cache_results) {
+	query_cache_capacity_ = capacity;
+	cache_query_results_ = capacity != 0 && cache_results;
+	query_plan_cache_.SetCapacity(capacity);
+	query_result_cache_.SetCapacity(cache_query_results_ ? capacity : 0);
+}
+
+QueryCacheStats SearchServer::GetQueryPlanCacheStats() const {
+	return query_plan_cache_.GetStats();
+}
+
+QueryCacheStats SearchServer::GetQueryResultCacheStats() const {
+	return query_result_cache_.GetStats();
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
@@ -61,69 +288,198 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 
 SearchServer::matched_words_status SearchServer::MatchDocument(std::execution::sequenced_policy ,std::string_view raw_query,
 	int document_id) const {
+	// A malformed query is reported before an unknown id
 	Query query = ParseQuery(false,raw_query);
+	const int ordinal = GetDocumentOrdinal(document_id);
 	std::vector<std::string_view> matched_words;
-	for (std::string_view word : query.minus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
-			continue;
-		}
-		if (word_to_document_freqs_.at(word).count(document_id)) {
-			return  { matched_words, documents_.at(document_id).status };
+	for (const uint32_t term_id : query.minus_terms) {
+		if (postings_[term_id].Contains(ordinal)) {
+			return  { matched_words, document_statuses_[ordinal] };
 		}
 	}
-	for (std::string_view word : query.plus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
-			continue;
-		}
-		if (word_to_document_freqs_.at(word).count(document_id)) {
-			matched_words.push_back(word);
+	for (const uint32_t term_id : query.plus_terms) {
+		if (postings_[term_id].Contains(ordinal)) {
+			// Views into the dictionary outlive the caller's query string
+			matched_words.push_back(terms_.GetTerm(term_id));
 		}
 	}
-	return { matched_words, documents_.at(document_id).status };
+	std::sort(matched_words.begin(), matched_words.end());
+	return { matched_words, document_statuses_[ordinal] };
 }
 
 SearchServer::matched_words_status SearchServer::MatchDocument(std::execution::parallel_policy, std::string_view raw_query, int document_id) const {
-	if (!ids_.count(document_id)) {
-		throw std::out_of_range("Document ID out of range");
-	}
+	const int ordinal = GetDocumentOrdinal(document_id);
+	const auto document_terms = GetDocumentTerms(ordinal);
+	const auto has_term = [&document_terms](uint32_t term_id) {
+		return std::binary_search(document_terms.first, document_terms.second, TermFrequency{ term_id, 0, 0.0 },
+			[](const TermFrequency& lhs, const TermFrequency& rhs) { return lhs.term_id < rhs.term_id; });
+	};
 	auto query = ParseQuery(true, raw_query);
 
-	std::sort(query.minus_words.begin(), query.minus_words.end());
-	query.minus_words.erase(std::unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
+	if (std::any_of(query.minus_terms.begin(), query.minus_terms.end(), has_term)) {
+		return { std::vector<std::string_view>{}, document_statuses_[ordinal] };
+	}
 
+	std::sort(query.plus_terms.begin(), query.plus_terms.end());
+	query.plus_terms.erase(std::unique(query.plus_terms.begin(), query.plus_terms.end()), query.plus_terms.end());
 
-	if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [this, document_id](std::string_view word) {
-		return ids_to_word_freq_.at(document_id).count(word);
-		})) {
-		return { {}, documents_.at(document_id).status };
-	}
+	std::vector<uint32_t> matched_terms(query.plus_terms.size());
 
-	std::sort(query.plus_words.begin(), query.plus_words.end());
-	query.plus_words.erase(std::unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
 
-	std::vector<std::string_view> matched_words(query.plus_words.size());
+	auto it_for_resize = std::copy_if(query.plus_terms.begin(), query.plus_terms.end(), matched_terms.begin(), has_term);
+	matched_terms.resize(std::distance(matched_terms.begin(), it_for_resize));
 
+	std::vector<std::string_view> matched_words(matched_terms.size());
+	std::transform(matched_terms.begin(), matched_terms.end(), matched_words.begin(),
+		[this](uint32_t term_id) { return terms_.GetTerm(term_id); });
+	std::sort(matched_words.begin(), matched_words.end());
+	return { matched_words, document_statuses_[ordinal] };
+}
 
-	auto it_for_resize = std::copy_if(query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [this, document_id](std::string_view word) {
-		return ids_to_word_freq_.at(document_id).count(word);
-		});
-	matched_words.resize(std::distance(matched_words.begin(), it_for_resize));
-	return { matched_words, documents_.at(document_id).status };
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+	std::map<std::string_view, double> word_freqs;
+	const auto ordinal_it = document_ordinals_.find(document_id);
+	if (ordinal_it != document_ordinals_.end()) {
+		const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal_it->second);
+		for (auto it = terms_begin; it != terms_end; ++it) {
+			word_freqs.emplace(terms_.GetTerm(it->term_id), it->term_freq);
+		}
+	}
+	return word_freqs;
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-	if (ids_to_word_freq_.count(document_id)) return ids_to_word_freq_.at(document_id);
-	else return empty_map_;
+std::vector<uint32_t> SearchServer::GetDocumentTermIds(int document_id) const {
+	std::vector<uint32_t> term_ids;
+	const auto ordinal_it = document_ordinals_.find(document_id);
+	if (ordinal_it != document_ordinals_.end()) {
+		const auto [terms_begin, terms_end] = GetDocumentTerms(ordinal_it->second);
+		term_ids.reserve(terms_end - terms_begin);
+		for (auto it = terms_begin; it != terms_end; ++it) {
+			term_ids.push_back(it->term_id);
+		}
+	}
+	return term_ids;
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+	// Snapshots never carry tombstones, which keeps their format and size unchanged
+	if (removed_document_count_ != 0) {
+		BuildCompacted().SaveSnapshot(path);
+		return;
+	}
+	SnapshotWriter writer(path);
+	writer.Write<uint64_t>(stop_words_.size());
+	for (const std::string& word : stop_words_) {
+		writer.WriteString(word);
+	}
+	terms_.SaveSnapshot(writer);
+	writer.Write<uint64_t>(postings_.size());
+	for (const PostingList& postings : postings_) {
+		postings.SaveSnapshot(writer);
+	}
+	writer.WriteArray(document_ids_.data(), document_ids_.size());
+	writer.WriteArray(document_inverse_lengths_.data(), document_inverse_lengths_.size());
+	writer.WriteArray(document_ratings_.data(), document_ratings_.size());
+	writer.WriteArray(document_statuses_.data(), document_statuses_.size());
+	writer.WriteArray(document_term_offsets_.data(), document_term_offsets_.size());
+	writer.WriteArray(document_terms_.data(), document_terms_.size());
+	// Ordinals of the live documents, in id order
+	std::vector<int> ordinals;
+	ordinals.reserve(document_ordinals_.size());
+	for (const auto [document_id, ordinal] : document_ordinals_) {
+		ordinals.push_back(ordinal);
+	}
+	writer.WriteArray(ordinals.data(), ordinals.size());
+	writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+	SnapshotReader reader(path);
+	const uint64_t stop_word_count = reader.Read<uint64_t>();
+	std::vector<std::string_view> stop_words;
+	for (uint64_t i = 0; i < stop_word_count; ++i) {
+		stop_words.push_back(reader.ReadString());
+	}
+	SearchServer server = [&stop_words]() {
+		try {
+			return SearchServer(stop_words);
+		}
+		catch (const std::invalid_argument&) {
+			throw std::runtime_error("damaged snapshot: invalid stop words");
+		}
+	}();
+	server.snapshot_file_ = reader.GetFile();
+
+	server.terms_.LoadSnapshot(reader);
+	const uint64_t posting_list_count = reader.Read<uint64_t>();
+	if (posting_list_count != server.terms_.size()) {
+		throw std::runtime_error("damaged snapshot: posting lists don't match the dictionary");
+	}
+	server.postings_.resize(posting_list_count);
+	for (PostingList& postings : server.postings_) {
+		postings.LoadSnapshot(reader);
+	}
+	server.document_ids_ = reader.ReadArray<int>();
+	server.document_inverse_lengths_ = reader.ReadArray<double>();
+	server.document_ratings_ = reader.ReadArray<int>();
+	server.document_statuses_ = reader.ReadArray<DocumentStatus>();
+	server.document_term_offsets_ = reader.ReadArray<uint64_t>();
+	server.document_terms_ = reader.ReadArray<TermFrequency>();
+	const size_t document_count = server.document_ids_.size();
+	if (server.document_inverse_lengths_.size() != document_count || server.document_ratings_.size() != document_count
+		|| server.document_statuses_.size() != document_count || server.document_term_offsets_.size() != document_count) {
+		throw std::runtime_error("damaged snapshot: document arrays differ in size");
+	}
+	// Everything the arrays index with is checked, so a damaged file can't be read out of bounds
+	for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+		const uint64_t last = ordinal + 1 < document_count
+			? server.document_term_offsets_[ordinal + 1] : server.document_terms_.size();
+		if (server.document_term_offsets_[ordinal] > last || last > server.document_terms_.size()) {
+			throw std::runtime_error("damaged snapshot: document term offset out of range");
+		}
+	}
+	for (const TermFrequency& term : server.document_terms_) {
+		if (term.term_id >= posting_list_count) {
+			throw std::runtime_error("damaged snapshot: term id out of range");
+		}
+	}
+	for (const PostingList& postings : server.postings_) {
+		if (!postings.HasIdsWithin(0, static_cast<int>(document_count))) {
+			throw std::runtime_error("damaged snapshot: posting out of range");
+		}
+	}
+
+	for (const int ordinal : reader.ReadArray<int>()) {
+		if (ordinal < 0 || static_cast<size_t>(ordinal) >= document_count) {
+			throw std::runtime_error("damaged snapshot: document ordinal out of range");
+		}
+		server.document_ordinals_.emplace_hint(server.document_ordinals_.end(), server.document_ids_[ordinal], ordinal);
+	}
+	return server;
 }
 
 
 bool SearchServer::IsStopWord(std::string_view word) const {
-	return stop_words_.count(word) > 0;
+	return stop_word_filter_.Contains(word);
+}
+
+int SearchServer::GetDocumentOrdinal(int document_id) const {
+	const auto ordinal_it = document_ordinals_.find(document_id);
+	if (ordinal_it == document_ordinals_.end()) {
+		throw std::out_of_range("Document ID out of range");
+	}
+	return ordinal_it->second;
+}
+
+std::pair<const SearchServer::TermFrequency*, const SearchServer::TermFrequency*> SearchServer::GetDocumentTerms(int ordinal) const {
+	const size_t last = static_cast<size_t>(ordinal) + 1 < document_term_offsets_.size()
+		? document_term_offsets_[ordinal + 1] : document_terms_.size();
+	return { document_terms_.data() + document_term_offsets_[ordinal], document_terms_.data() + last };
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
+std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text, bool& has_control_chars) const {
 	std::vector<std::string_view> words;
-	for (const std::string_view word : SplitIntoWords(text)) {
+	for (const std::string_view word : SplitIntoWords(text, has_control_chars)) {
 		if (!IsStopWord(word)) {
 			words.push_back(word);
 		}
@@ -138,15 +494,126 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 	return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
 }
 
+SearchServer::AddResult SearchServer::CheckDocumentWord(std::string_view word, bool has_control_chars) {
+	if (has_control_chars && !IsValidWord(word)) {
+		return AddResult::INAPPROPRIATE_SYMBOLS;
+	}
+	if (word[0] == '-' && (word.size() == 1 || word[1] == '-')) {
+		return AddResult::WRONG_MINUS_WORD_FORMAT;
+	}
+	return AddResult::ADDED;
+}
+
+SearchServer::PreparedDocuments SearchServer::PrepareDocuments(const NewDocument* first, const NewDocument* last) const {
+	PreparedDocuments prepared;
+	std::unordered_map<std::string_view, uint32_t> local_ids;
+	std::vector<uint32_t> term_ids;
+	for (const NewDocument* document = first; document != last; ++document) {
+		bool has_control_chars = false;
+		const std::vector<std::string_view> words = SplitIntoWordsNoStop(document->text, has_control_chars);
+		AddResult result = AddResult::ADDED;
+		for (auto word = words.begin(); word != words.end() && result == AddResult::ADDED; ++word) {
+			result = CheckDocumentWord(*word, has_control_chars);
+		}
+		prepared.results.push_back(result);
+		prepared.word_counts.push_back(words.size());
+		prepared.term_offsets.push_back(prepared.term_counts.size());
+		if (result != AddResult::ADDED) {
+			continue;
+		}
+
+		term_ids.clear();
+		for (const std::string_view word : words) {
+			const auto [it, inserted] = local_ids.emplace(word, static_cast<uint32_t>(prepared.terms.size()));
+			if (inserted) {
+				prepared.terms.push_back(word);
+			}
+			term_ids.push_back(it->second);
+		}
+		std::sort(term_ids.begin(), term_ids.end());
+		const size_t document_first = prepared.term_counts.size();
+		for (const uint32_t term_id : term_ids) {
+			if (prepared.term_counts.size() == document_first || prepared.term_counts.back().term_id != term_id) {
+				prepared.term_counts.push_back({ term_id, 0 });
+			}
+			++prepared.term_counts.back().count;
+		}
+	}
+	prepared.term_offsets.push_back(prepared.term_counts.size());
+	return prepared;
+}
+
+std::vector<SearchServer::AddResult> SearchServer::MergePreparedDocuments(const std::vector<NewDocument>& documents,
+	const std::vector<PreparedDocuments>& parts) {
+	std::vector<AddResult> results;
+	results.reserve(documents.size());
+	std::vector<TermCount> term_counts;
+	size_t document_index = 0;
+	for (const PreparedDocuments& part : parts) {
+		// Words are interned once per part and only when an accepted document uses them
+		std::vector<uint32_t> global_ids(part.terms.size(), TermDictionary::NO_TERM);
+		for (size_t i = 0; i < part.results.size(); ++i, ++document_index) {
+			const NewDocument& document = documents[document_index];
+			AddResult result = part.results[i];
+			// Checked here, in batch order, so a repeated id fails like a second AddDocument would
+			if (document_ordinals_.count(document.id) != 0 || document.id < 0) {
+				result = AddResult::INAPPROPRIATE_ID;
+			}
+			results.push_back(result);
+			if (result != AddResult::ADDED) {
+				continue;
+			}
+
+			term_counts.clear();
+			for (size_t j = part.term_offsets[i]; j < part.term_offsets[i + 1]; ++j) {
+				const auto [local_id, count] = part.term_counts[j];
+				if (global_ids[local_id] == TermDictionary::NO_TERM) {
+					global_ids[local_id] = terms_.Intern(part.terms[local_id]);
+				}
+				term_counts.push_back({ global_ids[local_id], count });
+			}
+			std::sort(term_counts.begin(), term_counts.end(),
+				[](const TermCount& lhs, const TermCount& rhs) { return lhs.term_id < rhs.term_id; });
+			AppendDocument(document.id, term_counts.data(), term_counts.data() + term_counts.size(),
+				part.word_counts[i], document.status, ComputeAverageRating(document.ratings));
+		}
+	}
+	return results;
+}
+
+void SearchServer::AppendDocument(int document_id, const TermCount* first, const TermCount* last, size_t word_count,
+	DocumentStatus status, int rating) {
+	if (postings_.size() < terms_.size()) {
+		postings_.resize(terms_.size());
+	}
+	const double inv_word_count = 1.0 / word_count;
+	const int ordinal = static_cast<int>(document_ids_.size());
+
+	document_term_offsets_.Mutable().push_back(document_terms_.size());
+	std::vector<TermFrequency>& document_terms = document_terms_.Mutable();
+	// Ordinals only grow, so every posting list update is an append
+	for (const TermCount* term = first; term != last; ++term) {
+		document_terms.push_back({ term->term_id, 0, term->count * inv_word_count });
+		postings_[term->term_id].Add(ordinal, term->count, document_terms.back().term_freq);
+	}
+	document_ids_.Mutable().push_back(document_id);
+	document_inverse_lengths_.Mutable().push_back(inv_word_count);
+	document_ratings_.Mutable().push_back(rating);
+	document_statuses_.Mutable().push_back(status);
+	document_ordinals_.emplace(document_id, ordinal);
+	++index_epoch_;
+	InvalidateScoringTables();
+}
+
 bool SearchServer::IsValidWord(std::string_view word) {
 	return std::none_of(word.begin(), word.end(), [](char c) {
 		return c >= '\0' && c < ' ';
 		});
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text, bool has_control_chars) const {
 	bool is_minus = false;
-	if (!IsValidWord(text)) throw std::invalid_argument("inappropriate symbols");
+	if (has_control_chars && !IsValidWord(text)) throw std::invalid_argument("inappropriate symbols");
 	// Word shouldn't be empty
 	if (text[0] == '-') {
 		is_minus = true;
@@ -159,27 +626,107 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
 
 SearchServer::Query SearchServer::ParseQuery(bool par, std::string_view text) const {
 	Query query;
-	for (const std::string_view word : SplitIntoWords(text)) {
-		QueryWord query_word = ParseQueryWord(word);
+	bool has_control_chars = false;
+	for (const std::string_view word : SplitIntoWords(text, has_control_chars)) {
+		QueryWord query_word = ParseQueryWord(word, has_control_chars);
 		if (!query_word.is_stop) {
+			const uint32_t term_id = terms_.Find(query_word.data);
+			if (term_id == TermDictionary::NO_TERM) {
+				continue;
+			}
 			if (query_word.is_minus) {
-				query.minus_words.push_back(query_word.data);
+				query.minus_terms.push_back(term_id);
 			}
 			else {
-				query.plus_words.push_back(query_word.data);
+				query.plus_terms.push_back(term_id);
 			}
 		}
 	}
 	if (!par) {
-		std::sort(query.plus_words.begin(), query.plus_words.end());
-		query.plus_words.erase(std::unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
-		std::sort(query.minus_words.begin(), query.minus_words.end());
-		query.minus_words.erase(std::unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
+		std::sort(query.plus_terms.begin(), query.plus_terms.end());
+		query.plus_terms.erase(std::unique(query.plus_terms.begin(), query.plus_terms.end()), query.plus_terms.end());
+		// Term ids depend on the order documents came in; summing the scores in word order gives
+		// the same relevance bits on any server holding the same documents
+		std::sort(query.plus_terms.begin(), query.plus_terms.end(), [this](uint32_t lhs, uint32_t rhs) {
+			return terms_.GetTerm(lhs) < terms_.GetTerm(rhs);
+			});
+		std::sort(query.minus_terms.begin(), query.minus_terms.end());
+		query.minus_terms.erase(std::unique(query.minus_terms.begin(), query.minus_terms.end()), query.minus_terms.end());
 	}
 
 	return query;
 }
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+
+SearchServer::Query SearchServer::ParseQuery(std::string_view text, const CollectionStatistics& statistics) const {
+	Query query = *GetQueryPlan(text);
+	EnsureScoringTables();
+	query.plus_term_idfs.reserve(query.plus_terms.size());
+	for (const uint32_t term_id : query.plus_terms) {
+		const int document_freq = statistics.document_freq(terms_.GetTerm(term_id));
+		query.plus_term_idfs.push_back(document_freq > 0 ? log(statistics.document_count * 1.0 / document_freq) : 0.0);
+	}
+	return query;
+}
+
+std::shared_ptr<const SearchServer::Query> SearchServer::GetQueryPlan(std::string_view raw_query) const {
+	if (query_cache_capacity_ == 0) {
+		return std::make_shared<const Query>(ParseQuery(false, raw_query));
+	}
+	if (auto cached = query_plan_cache_.Find(raw_query, index_epoch_)) {
+		return std::move(*cached);
+	}
+	auto query = std::make_shared<const Query>(ParseQuery(false, raw_query));
+	query_plan_cache_.Insert(raw_query, index_epoch_, query);
+	return query;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(uint32_t term_id) const {
+	return log(GetDocumentCount() * 1.0 / GetLiveDocumentFreq(term_id));
+}
+
+size_t SearchServer::GetLiveDocumentFreq(uint32_t term_id) const {
+	return postings_[term_id].size() - (term_id < removed_postings_.size() ? removed_postings_[term_id] : 0);
+}
+
+void SearchServer::InvalidateScoringTables() {
+	scoring_tables_state_.fresh.store(false, std::memory_order_release);
+}
+
+void SearchServer::PrepareScoringTables() const {
+	EnsureScoringTables();
+}
+
+void SearchServer::EnsureScoringTables() const {
+	if (scoring_tables_state_.fresh.load(std::memory_order_acquire)) {
+		return;
+	}
+	std::lock_guard guard(scoring_tables_state_.mutex);
+	if (scoring_tables_state_.fresh.load(std::memory_order_relaxed)) {
+		return;
+	}
+	inverse_document_freqs_.resize(postings_.size());
+	for (uint32_t term_id = 0; term_id < postings_.size(); ++term_id) {
+		inverse_document_freqs_[term_id] = GetLiveDocumentFreq(term_id) == 0 ? 0.0 : ComputeWordInverseDocumentFreq(term_id);
+	}
+	term_impacts_.resize(precomputed_impacts_ ? postings_.size() : 0);
+	term_impacts_.shrink_to_fit();
+	for (uint32_t term_id = 0; term_id < term_impacts_.size(); ++term_id) {
+		std::vector<double>& impacts = term_impacts_[term_id];
+		impacts.resize(postings_[term_id].size());
+		postings_[term_id].ForEach(0, std::numeric_limits<int>::max(),
+			[this, &impacts, idf = inverse_document_freqs_[term_id]](size_t position, int ordinal, uint32_t term_count) {
+				impacts[position] = term_count * document_inverse_lengths_[ordinal] * idf;
+			});
+	}
+	scoring_tables_state_.fresh.store(true, std::memory_order_release);
+}
+
+SearchServer::TermScorer SearchServer::GetTermScorer(const Query& query, size_t i) const {
+	const uint32_t term_id = query.plus_terms[i];
+	if (!query.plus_term_idfs.empty()) {
+		// Precomputed impacts hold the local idf
+		return { nullptr, document_inverse_lengths_.data(), query.plus_term_idfs[i] };
+	}
+	return { precomputed_impacts_ ? term_impacts_[term_id].data() : nullptr, document_inverse_lengths_.data(),
+		inverse_document_freqs_[term_id] };
 }
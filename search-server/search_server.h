@@ -8,13 +8,27 @@
 #include<algorithm>
 #include <execution>
 #include <mutex>
+#include <atomic>
 #include <string_view>
 #include<functional>
 #include <thread>
+#include <numeric>
+#include <limits>
+#include <memory>
+#include <future>
 
 #include "string_processing.h"
 #include "document.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "stop_word_filter.h"
+#include "top_documents.h"
+#include "relevance_accumulator.h"
+#include "mapped_array.h"
+#include "mapped_file.h"
+#include "query_cache.h"
+#include "query_executor.h"
+#include "cancellation_token.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
@@ -27,9 +41,61 @@ public:
     inline static constexpr double eps = 1e-6;
     using matched_words_status = std::tuple<std::vector<std::string_view>, DocumentStatus>;
 
+    // Walks the external document ids in ascending order
+    class DocumentIdIterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        explicit DocumentIdIterator(std::map<int, int>::const_iterator it)
+            : it_(it) {
+        }
+
+        reference operator*() const {
+            return it_->first;
+        }
+
+        DocumentIdIterator& operator++() {
+            ++it_;
+            return *this;
+        }
+
+        DocumentIdIterator operator++(int) {
+            DocumentIdIterator prev = *this;
+            ++it_;
+            return prev;
+        }
+
+        DocumentIdIterator& operator--() {
+            --it_;
+            return *this;
+        }
+
+        DocumentIdIterator operator--(int) {
+            DocumentIdIterator prev = *this;
+            --it_;
+            return prev;
+        }
+
+        bool operator==(const DocumentIdIterator& other) const {
+            return it_ == other.it_;
+        }
+
+        bool operator!=(const DocumentIdIterator& other) const {
+            return it_ != other.it_;
+        }
+
+    private:
+        std::map<int, int>::const_iterator it_;
+    };
+
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words)
-        : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+        : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+        , stop_word_filter_(stop_words_) {
         for (std::string_view word : stop_words_)
             if (!IsValidWord(word)) throw std::invalid_argument("inappropriate symbols");
     }
@@ -47,34 +113,153 @@ public:
     void AddDocument(int document_id, std::string_view document, DocumentStatus status,
         const std::vector<int>& ratings);
 
+    // Input of AddDocuments; the text only has to live until the call returns
+    struct NewDocument {
+        int id;
+        std::string_view text;
+        DocumentStatus status;
+        std::vector<int> ratings;
+    };
+
+    // Outcome of each document of AddDocuments; the errors are the ones AddDocument throws
+    enum class AddResult {
+        ADDED,
+        INAPPROPRIATE_ID,
+        INAPPROPRIATE_SYMBOLS,
+        WRONG_MINUS_WORD_FORMAT,
+    };
+
+    // Result of a query that may be cancelled: complete is false when the query stopped early,
+    // documents then rank only what was scored up to that point
+    struct QueryResult {
+        std::vector<Document> documents;
+        bool complete = true;
+    };
+
+    // Document counts of a collection split over several servers, so that each part scores its
+    // documents with the idf of the whole collection
+    struct CollectionStatistics {
+        int document_count = 0;
+        // Documents of the collection containing the word
+        std::function<int(std::string_view word)> document_freq;
+    };
+
+    // Statistics of the collection made of servers, which must outlive the result
+    static CollectionStatistics GetCollectionStatistics(std::vector<const SearchServer*> servers);
+
+    // Adds the batch as AddDocument would, one document after another, but reports failed documents
+    // instead of throwing. The parallel version tokenizes chunks of the batch concurrently,
+    // each against its own dictionary, and merges them into the index in one sequential pass
+    std::vector<AddResult> AddDocuments(const std::vector<NewDocument>& documents);
+
+    std::vector<AddResult> AddDocuments(std::execution::sequenced_policy, const std::vector<NewDocument>& documents);
+
+    std::vector<AddResult> AddDocuments(std::execution::parallel_policy, const std::vector<NewDocument>& documents);
+
+    // Only marks the document removed: queries skip it at once, while its postings, forward index
+    // entries and the terms no other document has stay until Compact is called
     void RemoveDocument(int document_id);
 
+    // Rebuilds the index from the live documents, dropping the postings of removed documents and the
+    // terms only they had. Takes time proportional to the whole index. Term ids change, and the word
+    // views returned by MatchDocument and GetWordFrequencies before the call dangle after it
+    void Compact();
+
+    // Documents removed since the last compaction
+    int GetRemovedDocumentCount() const;
 
+    // Adds every document of other, which must have the same stop words and no id in common with
+    // this server; throws std::invalid_argument otherwise, before anything is added
+    void AddDocumentsFrom(const SearchServer& other);
 
+    // The same for the documents of other whose ids document_filter accepts
+    void AddDocumentsFrom(const SearchServer& other, const std::function<bool(int document_id)>& document_filter);
 
+
+
+
+    // Marking a document is cheap, so both policies do it sequentially
     template<typename ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
 
+    // max_count bounds the result size; the selection keeps only that many candidates at a time
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
     template <typename ExecutionPolicy,typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy,std::string_view raw_query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template<typename ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy,std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy,std::string_view raw_query, DocumentStatus status,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template<typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const;
 
+    // FindTopDocuments(raw_query, DocumentStatus::ACTUAL, max_count) that writes the documents to output,
+    // which must have room for max_count of them. Returns the number written
+    size_t FindTopDocumentsInto(std::string_view raw_query, Document* output,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // FindTopDocuments(raw_query, DocumentStatus::ACTUAL, max_count) that stops once token is cancelled.
+    // The token is checked before each posting list, or each window of dynamic pruning
+    QueryResult FindTopDocuments(std::string_view raw_query, const CancellationToken& token,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Runs the cancellable query on executor. The server must outlive the future and stay unchanged
+    // until it is ready; the query text is copied
+    std::future<QueryResult> FindTopDocumentsAsync(std::string_view raw_query, CancellationToken token = CancellationToken(),
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT, QueryExecutor& executor = QueryExecutor::GetDefault()) const;
+
+    // FindTopDocuments(raw_query, DocumentStatus::ACTUAL, max_count) scored with the idf of a
+    // collection this server is a part of
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const CollectionStatistics& statistics,
+        size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // The same with a predicate instead of ACTUAL
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const CollectionStatistics& statistics,
+        DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
     int GetDocumentCount() const;
 
+    bool ContainsDocument(int document_id) const;
+
+    // Number of documents containing word; 0 for unknown words and stop words
+    int GetDocumentFreq(std::string_view word) const;
+
+    // Upper bound on the worker threads a parallel query uses; defaults to the hardware concurrency.
+    // Not synchronized with running queries
+    void SetParallelism(size_t parallelism);
+
+    // Keep tf * idf of every posting next to the posting lists instead of multiplying during scoring.
+    // Costs one double per posting. Not synchronized with running queries
+    void SetPrecomputedImpacts(bool enabled);
+
+    // Evaluate queries with MaxScore: documents that cannot reach the current top are skipped
+    // using per-term score upper bounds. Results are identical to the exhaustive evaluation.
+    // Not synchronized with running queries
+    void SetDynamicPruning(bool enabled);
+
+    // Cache up to capacity parsed queries and, with cache_results, the results of the FindTopDocuments
+    // calls that filter by status. AddDocument and RemoveDocument invalidate every entry.
+    // 0 turns caching off, the default. Clears the caches; not synchronized with running queries
+    void SetQueryCache(size_t capacity, bool cache_results = false);
+
+    QueryCacheStats GetQueryPlanCacheStats() const;
+
+    QueryCacheStats GetQueryResultCacheStats() const;
+
+    // Builds the per-term scoring tables now instead of in the first query after a change
+    void PrepareScoringTables() const;
+
     matched_words_status MatchDocument(std::string_view raw_query,
         int document_id) const;
 
@@ -84,103 +269,268 @@ public:
     matched_words_status MatchDocument(std::execution::parallel_policy, std::string_view raw_query,
         int document_id) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Built from the forward index on each call; empty for unknown ids
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
 
-    std::set<int>::const_iterator begin() const {
-        return ids_.begin();
+    // Ids of the document's distinct words in ascending order, straight from the forward index.
+    // An id stands for the same word only within this server until the next compaction; empty for unknown ids
+    std::vector<uint32_t> GetDocumentTermIds(int document_id) const;
+
+    // Writes the whole index to a versioned binary file. Throws std::runtime_error on I/O errors
+    void SaveSnapshot(const std::string& path) const;
+
+    // Maps a file written by SaveSnapshot and serves queries straight from its pages: only
+    // the id map and the term views are rebuilt. Arrays are copied on their first change.
+    // Only the structure of the file is checked. Throws std::runtime_error for unusable files
+    static SearchServer LoadSnapshot(const std::string& path);
+
+    DocumentIdIterator begin() const {
+        return DocumentIdIterator(document_ordinals_.begin());
     }
 
-    std::set<int>::const_iterator end() const {
-        return ids_.end();
+    DocumentIdIterator end() const {
+        return DocumentIdIterator(document_ordinals_.end());
     }
 
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    struct TermFrequency {
+        uint32_t term_id;
+        // The padding is a zeroed member, so snapshots, which store the array raw, are deterministic
+        uint32_t padding = 0;
+        double term_freq;
     };
+
+    struct TermCount {
+        uint32_t term_id;
+        uint32_t count;
+    };
+
+    // Part of an AddDocuments batch tokenized against a local dictionary
+    struct PreparedDocuments {
+        // Local term id -> word
+        std::vector<std::string_view> terms;
+        // Per document; ids are checked only during the merge
+        std::vector<AddResult> results;
+        std::vector<size_t> word_counts;
+        // Runs of local term ids, sorted, for each document starting at its offset
+        std::vector<TermCount> term_counts;
+        std::vector<size_t> term_offsets;
+    };
+
     const std::set<std::string,std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::map<int, std::map<std::string_view, double>> ids_to_word_freq_;
-    std::set<std::string> all_words_;
-    std::map<std::string_view, double > empty_map_;
-    std::set<int> ids_;
+    // Answers IsStopWord; built once from stop_words_
+    const StopWordFilter stop_word_filter_;
+    TermDictionary terms_;
+    // Indexed by term id. Posting lists hold internal document ordinals, not external ids
+    std::vector<PostingList> postings_;
+    // The only external id -> ordinal translation; ordinals are handed out in increasing order
+    std::map<int, int> document_ordinals_;
+    // Per-document data, indexed by ordinal. Slots of removed documents stay behind unused
+    MappedArray<int> document_ids_;
+    // 1 / word count: postings store raw term counts, this turns them into term frequencies
+    MappedArray<double> document_inverse_lengths_;
+    MappedArray<int> document_ratings_;
+    MappedArray<DocumentStatus> document_statuses_;
+    // Forward index: the terms of each document sorted by term id, stored back to back.
+    // Entries of removed documents stay behind unused
+    MappedArray<TermFrequency> document_terms_;
+    // Start of each document's entries in document_terms_, indexed by ordinal
+    MappedArray<uint64_t> document_term_offsets_;
+    // Tombstones: one bit per ordinal, set for the documents removed since the last compaction
+    std::vector<uint64_t> removed_ordinals_;
+    size_t removed_document_count_ = 0;
+    // Postings of removed documents in each posting list, indexed by term id; may be shorter than postings_
+    std::vector<uint32_t> removed_postings_;
+    // Keeps a loaded snapshot mapped while the arrays view it
+    std::shared_ptr<const MappedFile> snapshot_file_;
+    size_t parallelism_ = std::max(1u, std::thread::hardware_concurrency());
+    bool precomputed_impacts_ = false;
+    bool dynamic_pruning_ = false;
+
+    // Lazy refresh state of the scoring tables; copies start out stale
+    struct ScoringTablesState {
+        ScoringTablesState() = default;
+        ScoringTablesState(const ScoringTablesState&) {
+        }
+        ScoringTablesState& operator=(const ScoringTablesState&) {
+            fresh.store(false);
+            return *this;
+        }
+        std::atomic<bool> fresh{ false };
+        std::mutex mutex;
+    };
+    // Both indexed by term id like postings_. Every change of the document count makes
+    // them stale, and the next query rebuilds them in one pass
+    mutable std::vector<double> inverse_document_freqs_;
+    mutable std::vector<std::vector<double>> term_impacts_;
+    mutable ScoringTablesState scoring_tables_state_;
 
     bool IsStopWord(std::string_view word) const;
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Throws std::out_of_range for unknown ids, like the former map lookups did
+    int GetDocumentOrdinal(int document_id) const;
+
+    bool IsRemoved(int ordinal) const {
+        const size_t word = static_cast<size_t>(ordinal) / 64;
+        return word < removed_ordinals_.size() && (removed_ordinals_[word] >> (ordinal % 64)) & 1;
+    }
+
+    // Live documents containing the term
+    size_t GetLiveDocumentFreq(uint32_t term_id) const;
+
+    // A server holding only the live documents of this one
+    SearchServer BuildCompacted() const;
+
+    // Forward index entries of the document
+    std::pair<const TermFrequency*, const TermFrequency*> GetDocumentTerms(int ordinal) const;
+
+    // has_control_chars tells whether some word needs the symbol check
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text, bool& has_control_chars) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     static bool IsValidWord(std::string_view word);
 
+    // The checks ParseQueryWord applies to document words, without throwing
+    static AddResult CheckDocumentWord(std::string_view word, bool has_control_chars);
+
+    PreparedDocuments PrepareDocuments(const NewDocument* first, const NewDocument* last) const;
+
+    std::vector<AddResult> MergePreparedDocuments(const std::vector<NewDocument>& documents,
+        const std::vector<PreparedDocuments>& parts);
+
+    // Indexes a validated document; term counts come sorted by term id
+    void AppendDocument(int document_id, const TermCount* first, const TermCount* last, size_t word_count,
+        DocumentStatus status, int rating);
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // The symbol check is skipped unless the tokenizer saw control characters in the text
+    QueryWord ParseQueryWord(std::string_view text, bool has_control_chars) const;
 
+    // Words are resolved to term ids once; words missing from the dictionary are dropped
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        // Unique and ordered by word text unless parsed for the parallel MatchDocument
+        std::vector<uint32_t> plus_terms;
+        std::vector<uint32_t> minus_terms;
+        // Collection-wide idf of each plus term; empty when the server's own statistics apply
+        std::vector<double> plus_term_idfs;
     };
 
     Query ParseQuery(bool par, std::string_view text) const;
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+    // The query with the idf of each plus term taken from statistics
+    Query ParseQuery(std::string_view text, const CollectionStatistics& statistics) const;
+
+    // Bumped by every change of the document set; cache entries remember the epoch they were made at
+    uint64_t index_epoch_ = 0;
+    size_t query_cache_capacity_ = 0;
+    bool cache_query_results_ = false;
+    mutable QueryCache<std::shared_ptr<const Query>> query_plan_cache_;
+    mutable QueryCache<std::shared_ptr<const std::vector<Document>>> query_result_cache_;
+
+    // The deduplicated query of FindTopDocuments, from the plan cache when it is on
+    std::shared_ptr<const Query> GetQueryPlan(std::string_view raw_query) const;
+
+    double ComputeWordInverseDocumentFreq(uint32_t term_id) const;
+
+    void InvalidateScoringTables();
+
+    // Called once per query before scoring
+    void EnsureScoringTables() const;
+
+    // Relevance a posting of one term adds to its document
+    struct TermScorer {
+        // Indexed by posting position; null unless precomputed impacts are on
+        const double* impacts;
+        const double* inverse_lengths;
+        double inverse_document_freq;
+
+        double operator()(size_t position, int ordinal, uint32_t term_count) const {
+            return impacts != nullptr ? impacts[position] : term_count * inverse_lengths[ordinal] * inverse_document_freq;
+        }
+    };
+
+    // Scorer of the i-th plus term; uses the idf the query carries when it has them
+    TermScorer GetTermScorer(const Query& query, size_t i) const;
 
+    static bool IsCancelled(const CancellationToken* cancellation) {
+        return cancellation != nullptr && cancellation->IsCancelled();
+    }
+
+    // Feed every matching document into top_documents. Returns false when cancellation stopped
+    // the scoring early; the documents scored so far are still fed
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy,const Query& query,
-        DocumentPredicate document_predicate) const;
+    bool FindAllDocuments(std::execution::sequenced_policy,const Query& query,
+        DocumentPredicate document_predicate, TopDocuments& top_documents,
+        const CancellationToken* cancellation = nullptr) const;
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy,const Query& query,
-        DocumentPredicate document_predicate) const;
+    bool FindAllDocuments(std::execution::parallel_policy,const Query& query,
+        DocumentPredicate document_predicate, TopDocuments& top_documents,
+        const CancellationToken* cancellation = nullptr) const;
+
+    // MaxScore over ordinals in [first, last). Expects the minus words to be already excluded in accumulator
+    template <typename DocumentPredicate>
+    bool FindTopDocumentsMaxScore(const Query& query, DocumentPredicate document_predicate, int first, int last,
+        RelevanceAccumulator& accumulator, TopDocuments& top_documents, const CancellationToken* cancellation) const;
 };
 
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq,raw_query,document_predicate);
+    DocumentPredicate document_predicate, size_t max_count) const {
+    return FindTopDocuments(std::execution::seq,raw_query,document_predicate,max_count);
 }
 
 
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const CollectionStatistics& statistics,
+    DocumentPredicate document_predicate, size_t max_count) const {
+    const Query query = ParseQuery(raw_query, statistics);
+    TopDocuments top_documents(max_count);
+    FindAllDocuments(std::execution::seq, query, document_predicate, top_documents);
+    return top_documents.Build();
+}
+
 template <typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
+    DocumentPredicate document_predicate, size_t max_count) const {
 
-    Query query = ParseQuery(false, raw_query);
+    const std::shared_ptr<const Query> query = GetQueryPlan(raw_query);
+    EnsureScoringTables();
 
-    auto result = FindAllDocuments(policy, query, document_predicate);
-
-    sort(result.begin(), result.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < eps) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (result.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        result.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return result;
+    TopDocuments top_documents(max_count);
+    FindAllDocuments(policy, *query, document_predicate, top_documents);
+    return top_documents.Build();
 
 }
 
 template<typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy,
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status,
+    size_t max_count) const {
+    const auto find_top_documents = [&]() {
+        return FindTopDocuments(policy,
+            raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+                return document_status == status;
+            }, max_count);
+    };
+    if (!cache_query_results_) {
+        return find_top_documents();
+    }
+    // The fixed-format suffix keeps keys of different queries apart
+    const std::string key = std::string(raw_query) + '\t' + std::to_string(static_cast<int>(status)) + ' ' + std::to_string(max_count);
+    if (const auto cached = query_result_cache_.Find(key, index_epoch_)) {
+        return **cached;
+    }
+    std::vector<Document> documents = find_top_documents();
+    query_result_cache_.Insert(key, index_epoch_, std::make_shared<const std::vector<Document>>(documents));
+    return documents;
 }
 
 template<typename ExecutionPolicy>
@@ -189,92 +539,224 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy,const Query& query,
-    DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
-        }
+bool SearchServer::FindAllDocuments(std::execution::sequenced_policy,const Query& query,
+    DocumentPredicate document_predicate, TopDocuments& top_documents, const CancellationToken* cancellation) const {
+    RelevanceAccumulator& accumulator = RelevanceAccumulator::ForCurrentThread();
+    accumulator.Reset(document_ids_.size());
+
+    // Minus words go first, so excluded documents are never scored
+    for (const uint32_t term_id : query.minus_terms) {
+        postings_[term_id].ForEach(0, std::numeric_limits<int>::max(),
+            [&accumulator](size_t, int ordinal, uint32_t) { accumulator.Exclude(ordinal); });
     }
 
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    if (dynamic_pruning_) {
+        return FindTopDocumentsMaxScore(query, document_predicate, 0, static_cast<int>(document_ids_.size()),
+            accumulator, top_documents, cancellation);
+    }
+
+    bool complete = true;
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        if (IsCancelled(cancellation)) {
+            complete = false;
+            break;
         }
+        const TermScorer scorer = GetTermScorer(query, i);
+        postings_[query.plus_terms[i]].ForEach(0, std::numeric_limits<int>::max(),
+            [this, &accumulator, &document_predicate, &scorer](size_t position, int ordinal, uint32_t term_count) {
+                if (!IsRemoved(ordinal) && !accumulator.IsExcluded(ordinal)
+                    && document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                    accumulator.Add(ordinal, scorer(position, ordinal, term_count));
+                }
+            });
     }
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    for (const int ordinal : accumulator.GetTouched()) {
+        top_documents.Add({ document_ids_[ordinal], accumulator.GetRelevance(ordinal), document_ratings_[ordinal] });
     }
-    return matched_documents;
+    return complete;
 }
 
 
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy,const Query& query,
-    DocumentPredicate document_predicate) const {
-
-    ConcurrentMap<int, double> document_to_relevance(std::thread::hardware_concurrency());
-
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [this,&document_predicate,&document_to_relevance](const std::string_view word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
+bool SearchServer::FindAllDocuments(std::execution::parallel_policy,const Query& query,
+    DocumentPredicate document_predicate, TopDocuments& top_documents, const CancellationToken* cancellation) const {
+
+    // Every partition owns a disjoint ordinal range and scores it with its worker's own
+    // accumulator, so the workers never share mutable state
+    const int document_count = static_cast<int>(document_ids_.size());
+    const int partition_count = static_cast<int>(std::max<size_t>(1, std::min<size_t>(parallelism_, document_count)));
+    std::vector<std::vector<Document>> partition_results(partition_count);
+    std::atomic<bool> complete = true;
+    std::vector<int> partitions(partition_count);
+    std::iota(partitions.begin(), partitions.end(), 0);
+
+    std::for_each(std::execution::par, partitions.begin(), partitions.end(),
+        [this, &query, &document_predicate, &top_documents, &partition_results, &complete, cancellation,
+            document_count, partition_count](int partition) {
+            const int first = static_cast<int>(static_cast<int64_t>(document_count) * partition / partition_count);
+            const int last = static_cast<int>(static_cast<int64_t>(document_count) * (partition + 1) / partition_count);
+
+            RelevanceAccumulator& accumulator = RelevanceAccumulator::ForCurrentThread();
+            accumulator.Reset(document_ids_.size());
+
+            for (const uint32_t term_id : query.minus_terms) {
+                postings_[term_id].ForEach(first, last,
+                    [&accumulator](size_t, int ordinal, uint32_t) { accumulator.Exclude(ordinal); });
+            }
+
+            TopDocuments partition_top(top_documents.GetMaxCount());
+            if (dynamic_pruning_) {
+                if (!FindTopDocumentsMaxScore(query, document_predicate, first, last, accumulator, partition_top, cancellation)) {
+                    complete = false;
                 }
+                partition_results[partition] = partition_top.Build();
+                return;
             }
-        });
 
+            for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+                if (IsCancelled(cancellation)) {
+                    complete = false;
+                    break;
+                }
+                const TermScorer scorer = GetTermScorer(query, i);
+                postings_[query.plus_terms[i]].ForEach(first, last,
+                    [this, &accumulator, &document_predicate, &scorer](size_t position, int ordinal, uint32_t term_count) {
+                        if (!IsRemoved(ordinal) && !accumulator.IsExcluded(ordinal)
+                            && document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                            accumulator.Add(ordinal, scorer(position, ordinal, term_count));
+                        }
+                    });
+            }
 
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [this, &document_to_relevance](const std::string_view word) {
-        if (word_to_document_freqs_.count(word) != 0) {
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.Erase(document_id);
+            for (const int ordinal : accumulator.GetTouched()) {
+                partition_top.Add({ document_ids_[ordinal], accumulator.GetRelevance(ordinal), document_ratings_[ordinal] });
             }
-        }
+            partition_results[partition] = partition_top.Build();
         });
 
-
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    for (const auto& documents : partition_results) {
+        for (const Document& document : documents) {
+            top_documents.Add(document);
+        }
     }
-    return matched_documents;
+    return complete;
 }
 
 
 template<typename ExecutionPolicy>
-void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    if (ids_to_word_freq_.count(document_id)) {
-        std::vector<std::string_view> temp_words(ids_to_word_freq_[document_id].size());
+void SearchServer::RemoveDocument(ExecutionPolicy&&, int document_id) {
+    RemoveDocument(document_id);
+}
 
-        std::transform(policy, ids_to_word_freq_[document_id].begin(), ids_to_word_freq_[document_id].end(), temp_words.begin(),
-            [](const auto& word) { return word.first; });
+template <typename DocumentPredicate>
+bool SearchServer::FindTopDocumentsMaxScore(const Query& query, DocumentPredicate document_predicate, int first, int last,
+    RelevanceAccumulator& accumulator, TopDocuments& top_documents, const CancellationToken* cancellation) const {
+    if (top_documents.GetMaxCount() == 0) {
+        return true;
+    }
+    struct TermCursor {
+        const PostingList* postings;
+        TermScorer scorer;
+        // Only the non-essential terms are probed through the cursor; it moves forward only
+        PostingList::Cursor cursor;
+        bool exhausted;
+        // Best relevance the term adds inside the current window
+        double window_bound;
+    };
 
-        std::for_each(policy, temp_words.begin(), temp_words.end(),
-            [this, document_id](const std::string_view word) { word_to_document_freqs_[word].erase(document_id); });
+    std::vector<TermCursor> cursors;
+    cursors.reserve(query.plus_terms.size());
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        const PostingList& postings = postings_[query.plus_terms[i]];
+        if (postings.GetMaxTermFreq(first, last) > 0.0) {
+            cursors.push_back({ &postings, GetTermScorer(query, i), PostingList::Cursor(postings), false, 0.0 });
+        }
+    }
 
-        ids_to_word_freq_.erase(document_id);
-        ids_.erase(document_id);
-        documents_.erase(document_id);
+    // A document below threshold can't displace the worst kept one, even through the rating tie-break
+    const auto threshold = [&top_documents]() {
+        return top_documents.IsFull() ? top_documents.GetWorst().relevance - eps : -std::numeric_limits<double>::infinity();
+    };
+
+    // Ordinals are scored window by window with per-block bounds of the terms. Terms whose bounds together
+    // stay below the threshold are non-essential: the essential ones are accumulated term-at-a-time, and
+    // each candidate they produce is completed with the non-essential terms or dropped as soon as it can't enter
+    constexpr int WINDOW_SIZE = 1 << 12;
+    std::vector<size_t> order(cursors.size());
+    std::vector<double> bounds(cursors.size());
+    std::vector<int> candidates;
+    for (int window_first = first; window_first < last && !cursors.empty(); window_first += WINDOW_SIZE) {
+        // Windows are added to top_documents as they finish, so stopping between them keeps a usable top
+        if (IsCancelled(cancellation)) {
+            return false;
+        }
+        const int window_last = std::min(last, window_first + WINDOW_SIZE);
+        for (TermCursor& cursor : cursors) {
+            cursor.window_bound = cursor.postings->GetMaxTermFreq(window_first, window_last) * cursor.scorer.inverse_document_freq;
+        }
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&cursors](size_t lhs, size_t rhs) {
+            return cursors[lhs].window_bound < cursors[rhs].window_bound;
+            });
+        // bounds[i] is the best relevance a document found only in cursors order[0..i] could get
+        size_t first_essential = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            bounds[i] = (i > 0 ? bounds[i - 1] : 0.0) + cursors[order[i]].window_bound;
+            if (bounds[i] < threshold()) {
+                first_essential = i + 1;
+            }
+        }
+
+        const size_t touched_before = accumulator.GetTouched().size();
+        for (size_t i = first_essential; i < order.size(); ++i) {
+            const TermScorer& scorer = cursors[order[i]].scorer;
+            cursors[order[i]].postings->ForEach(window_first, window_last,
+                [this, &accumulator, &document_predicate, &scorer](size_t position, int ordinal, uint32_t term_count) {
+                    if (!IsRemoved(ordinal) && !accumulator.IsExcluded(ordinal)
+                        && document_predicate(document_ids_[ordinal], document_statuses_[ordinal], document_ratings_[ordinal])) {
+                        accumulator.Add(ordinal, scorer(position, ordinal, term_count));
+                    }
+                });
+        }
+
+        // Walking the candidates in ordinal order lets the non-essential cursors only move forward.
+        // Sparse windows sort their few candidates, dense ones are cheaper to scan
+        const std::vector<int>& touched = accumulator.GetTouched();
+        candidates.clear();
+        if ((touched.size() - touched_before) * 16 < static_cast<size_t>(window_last - window_first)) {
+            candidates.assign(touched.begin() + touched_before, touched.end());
+            std::sort(candidates.begin(), candidates.end());
+        } else {
+            for (int ordinal = window_first; ordinal < window_last; ++ordinal) {
+                if (accumulator.IsTouched(ordinal)) {
+                    candidates.push_back(ordinal);
+                }
+            }
+        }
+
+        for (const int ordinal : candidates) {
+            double relevance = accumulator.GetRelevance(ordinal);
+            bool can_enter = true;
+            for (size_t i = first_essential; i-- > 0;) {
+                if (relevance + bounds[i] < threshold()) {
+                    can_enter = false;
+                    break;
+                }
+                TermCursor& cursor = cursors[order[i]];
+                if (cursor.exhausted || !cursor.cursor.SeekTo(ordinal)) {
+                    cursor.exhausted = true;
+                    continue;
+                }
+                if (cursor.cursor.GetDocumentId() == ordinal) {
+                    relevance += cursor.scorer(cursor.cursor.GetPosition(), ordinal, cursor.cursor.GetTermCount());
+                }
+            }
+            if (can_enter) {
+                top_documents.Add({ document_ids_[ordinal], relevance, document_ratings_[ordinal] });
+            }
+        }
     }
+    return true;
 }
-
@@ -0,0 +1,319 @@
+#include "segmented_search_server.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "string_processing.h"
+
+void SegmentedSearchServer::Tombstones::Add(int document_id, const SearchServer& server) {
+	document_ids.insert(document_id);
+	const uint32_t bit = static_cast<uint32_t>(document_id) % ID_FILTER_BITS;
+	id_filter[bit / 64] |= uint64_t{ 1 } << (bit % 64);
+	for (const auto [word, term_freq] : server.GetWordFrequencies(document_id)) {
+		const auto it = document_freqs.find(word);
+		if (it != document_freqs.end()) {
+			++it->second;
+		}
+		else {
+			document_freqs.emplace(word, 1);
+		}
+	}
+}
+
+bool SegmentedSearchServer::Segment::IsRemoved(int document_id) const {
+	const uint32_t bit = static_cast<uint32_t>(document_id) % Tombstones::ID_FILTER_BITS;
+	return (tombstones->id_filter[bit / 64] >> (bit % 64) & 1) != 0 && tombstones->document_ids.count(document_id) != 0;
+}
+
+int SegmentedSearchServer::Segment::GetDocumentCount() const {
+	return server->GetDocumentCount() - static_cast<int>(tombstones->document_ids.size());
+}
+
+int SegmentedSearchServer::Segment::GetDocumentFreq(std::string_view word) const {
+	int document_freq = server->GetDocumentFreq(word);
+	const auto it = tombstones->document_freqs.find(word);
+	if (it != tombstones->document_freqs.end()) {
+		document_freq -= it->second;
+	}
+	return document_freq;
+}
+
+double SegmentedSearchServer::Segment::GetRemovedRatio() const {
+	const int removed_count = static_cast<int>(tombstones->document_ids.size()) + server->GetRemovedDocumentCount();
+	return removed_count * 1.0 / std::max(server->GetDocumentCount() + server->GetRemovedDocumentCount(), 1);
+}
+
+SegmentedSearchServer::SegmentedSearchServer(std::string_view stop_words_text, MergePolicy policy)
+	: policy_(policy)
+	, prototype_(stop_words_text)
+	, version_(std::make_shared<const Version>(Version{ std::make_shared<Memtable>(prototype_), {} }))
+	, merge_thread_([this] { MergeLoop(); }) {
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+	{
+		std::lock_guard lock(merge_mutex_);
+		stopping_ = true;
+	}
+	merge_wake_.notify_all();
+	merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+	const std::vector<int>& ratings) {
+	std::unique_lock write_lock(write_mutex_);
+	const std::shared_ptr<const Version> version = LoadVersion();
+	for (const Segment& segment : version->segments) {
+		if (segment.server->ContainsDocument(document_id) && !segment.IsRemoved(document_id)) {
+			throw std::invalid_argument("inappropriate id");
+		}
+	}
+	Memtable& memtable = *version->memtable;
+	{
+		std::unique_lock lock(memtable.mutex);
+		memtable.server.AddDocument(document_id, document, status, ratings);
+	}
+	if (static_cast<size_t>(memtable.server.GetDocumentCount()) >= policy_.max_memtable_documents) {
+		SealMemtable(*version);
+		write_lock.unlock();
+		RequestMerge();
+	}
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+	std::unique_lock write_lock(write_mutex_);
+	const std::shared_ptr<const Version> version = LoadVersion();
+	Memtable& memtable = *version->memtable;
+	if (memtable.server.ContainsDocument(document_id)) {
+		std::unique_lock lock(memtable.mutex);
+		memtable.server.RemoveDocument(document_id);
+		return;
+	}
+	// Tombstones only change under write_mutex_, so they are read here without their lock
+	for (const Segment& segment : version->segments) {
+		if (!segment.server->ContainsDocument(document_id) || segment.IsRemoved(document_id)) {
+			continue;
+		}
+		{
+			std::unique_lock lock(segment.tombstones->mutex);
+			segment.tombstones->Add(document_id, *segment.server);
+		}
+		if (segment.GetRemovedRatio() >= policy_.max_removed_ratio) {
+			write_lock.unlock();
+			RequestMerge();
+		}
+		return;
+	}
+}
+
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query, size_t max_count) const {
+	const std::shared_ptr<const Version> version = LoadVersion();
+
+	// The document frequencies of the query words are gathered up front, so the in-memory segment is
+	// not locked while the sealed ones are searched
+	std::map<std::string_view, int> document_freqs;
+	for (const std::string_view word : SplitIntoWords(raw_query)) {
+		if (!word.empty() && word[0] != '-') {
+			document_freqs.emplace(word, 0);
+		}
+	}
+	// Held for the whole query, so the statistics count exactly the documents the search finds
+	std::vector<std::shared_lock<std::shared_mutex>> tombstone_locks;
+	tombstone_locks.reserve(version->segments.size());
+	for (const Segment& segment : version->segments) {
+		tombstone_locks.emplace_back(segment.tombstones->mutex);
+	}
+	SearchServer::CollectionStatistics statistics;
+	for (const Segment& segment : version->segments) {
+		statistics.document_count += segment.GetDocumentCount();
+		for (auto& [word, document_freq] : document_freqs) {
+			document_freq += segment.GetDocumentFreq(word);
+		}
+	}
+	statistics.document_freq = [&document_freqs](std::string_view word) {
+		const auto it = document_freqs.find(word);
+		return it != document_freqs.end() ? it->second : 0;
+	};
+
+	// A document lives in one segment, so the global top is the top of the segment tops
+	TopDocuments top_documents(max_count);
+	{
+		const Memtable& memtable = *version->memtable;
+		std::shared_lock lock(memtable.mutex);
+		statistics.document_count += memtable.server.GetDocumentCount();
+		for (auto& [word, document_freq] : document_freqs) {
+			document_freq += memtable.server.GetDocumentFreq(word);
+		}
+		for (const Document& document : memtable.server.FindTopDocuments(raw_query, statistics, max_count)) {
+			top_documents.Add(document);
+		}
+	}
+	for (const Segment& segment : version->segments) {
+		const std::vector<Document> documents = !segment.tombstones->document_ids.empty()
+			? segment.server->FindTopDocuments(raw_query, statistics, [&segment](int document_id, DocumentStatus status, int) {
+				return status == DocumentStatus::ACTUAL && !segment.IsRemoved(document_id);
+				}, max_count)
+			: segment.server->FindTopDocuments(raw_query, statistics, max_count);
+		for (const Document& document : documents) {
+			top_documents.Add(document);
+		}
+	}
+	return top_documents.Build();
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+	const std::shared_ptr<const Version> version = LoadVersion();
+	int document_count = 0;
+	{
+		std::shared_lock lock(version->memtable->mutex);
+		document_count = version->memtable->server.GetDocumentCount();
+	}
+	for (const Segment& segment : version->segments) {
+		std::shared_lock lock(segment.tombstones->mutex);
+		document_count += segment.GetDocumentCount();
+	}
+	return document_count;
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+	return LoadVersion()->segments.size();
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+	std::unique_lock lock(merge_mutex_);
+	merge_idle_.wait(lock, [this] { return !merge_requested_ && !merging_; });
+}
+
+std::shared_ptr<const SegmentedSearchServer::Version> SegmentedSearchServer::LoadVersion() const {
+	return std::atomic_load(&version_);
+}
+
+void SegmentedSearchServer::Publish(std::shared_ptr<Memtable> memtable, std::vector<Segment> segments) {
+	std::atomic_store(&version_, std::make_shared<const Version>(Version{ std::move(memtable), std::move(segments) }));
+}
+
+void SegmentedSearchServer::SealMemtable(const Version& version) {
+	// Built here, so queries never rebuild the tables of a sealed segment
+	version.memtable->server.PrepareScoringTables();
+	std::vector<Segment> segments = version.segments;
+	// No write reaches the memtable once it is sealed, so queries read it without its lock
+	segments.push_back({ std::shared_ptr<const SearchServer>(version.memtable, &version.memtable->server),
+		std::make_shared<Tombstones>() });
+	Publish(std::make_shared<Memtable>(prototype_), std::move(segments));
+}
+
+void SegmentedSearchServer::RequestMerge() {
+	{
+		std::lock_guard lock(merge_mutex_);
+		merge_requested_ = true;
+	}
+	merge_wake_.notify_one();
+}
+
+void SegmentedSearchServer::MergeLoop() {
+	std::unique_lock lock(merge_mutex_);
+	while (true) {
+		merge_wake_.wait(lock, [this] { return stopping_ || merge_requested_; });
+		if (stopping_) {
+			return;
+		}
+		merge_requested_ = false;
+		merging_ = true;
+		lock.unlock();
+		while (MergeOnce()) {
+		}
+		lock.lock();
+		merging_ = false;
+		merge_idle_.notify_all();
+	}
+}
+
+bool SegmentedSearchServer::MergeOnce() {
+	const std::vector<Segment> group = PickMergeGroup(*LoadVersion());
+	if (group.empty()) {
+		return false;
+	}
+
+	// Sealed segments never change, so the merge needs no lock; documents removed by now are left
+	// out, and the ones removed while the merge runs become tombstones of the result
+	std::vector<std::unordered_set<int>> merged_removals;
+	auto merged = std::make_shared<SearchServer>(prototype_);
+	for (const Segment& segment : group) {
+		{
+			std::shared_lock lock(segment.tombstones->mutex);
+			merged_removals.push_back(segment.tombstones->document_ids);
+		}
+		const std::unordered_set<int>& removed = merged_removals.back();
+		merged->AddDocumentsFrom(*segment.server, [&removed](int document_id) {
+			return removed.count(document_id) == 0;
+			});
+	}
+	merged->PrepareScoringTables();
+
+	std::lock_guard write_lock(write_mutex_);
+	const std::shared_ptr<const Version> version = LoadVersion();
+	auto tombstones = std::make_shared<Tombstones>();
+	std::vector<size_t> positions;
+	for (size_t i = 0; i < group.size(); ++i) {
+		// Only this thread replaces segments, so every input is still there
+		const auto it = std::find_if(version->segments.begin(), version->segments.end(), [&group, i](const Segment& segment) {
+			return segment.server == group[i].server;
+			});
+		positions.push_back(it - version->segments.begin());
+		for (const int document_id : group[i].tombstones->document_ids) {
+			if (merged_removals[i].count(document_id) == 0) {
+				tombstones->Add(document_id, *group[i].server);
+			}
+		}
+	}
+	std::sort(positions.begin(), positions.end());
+
+	std::vector<Segment> segments;
+	for (size_t i = 0, next_position = 0; i < version->segments.size(); ++i) {
+		if (next_position < positions.size() && positions[next_position] == i) {
+			if (next_position++ == 0) {
+				segments.push_back({ std::move(merged), std::move(tombstones) });
+			}
+			continue;
+		}
+		segments.push_back(version->segments[i]);
+	}
+	Publish(version->memtable, std::move(segments));
+	return true;
+}
+
+std::vector<SegmentedSearchServer::Segment> SegmentedSearchServer::PickMergeGroup(const Version& version) const {
+	std::vector<std::pair<int, Segment>> segments;
+	const Segment* rewrite = nullptr;
+	double max_removed_ratio = policy_.max_removed_ratio;
+	for (const Segment& segment : version.segments) {
+		std::shared_lock lock(segment.tombstones->mutex);
+		segments.emplace_back(segment.GetDocumentCount(), segment);
+		const double removed_ratio = segment.GetRemovedRatio();
+		if (removed_ratio > 0.0 && removed_ratio >= max_removed_ratio) {
+			rewrite = &segment;
+			max_removed_ratio = removed_ratio;
+		}
+	}
+	if (rewrite != nullptr) {
+		return { *rewrite };
+	}
+
+	const size_t merge_factor = std::max<size_t>(policy_.merge_factor, 2);
+	std::sort(segments.begin(), segments.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.first < rhs.first;
+		});
+	// The smallest tier first: merging small segments is cheap and removes the most of them
+	for (size_t i = 0; i + merge_factor <= segments.size(); ++i) {
+		const size_t smallest = std::max(segments[i].first, 1);
+		const size_t largest = segments[i + merge_factor - 1].first;
+		if (largest <= smallest * merge_factor) {
+			std::vector<Segment> group;
+			for (size_t j = i; j < i + merge_factor; ++j) {
+				group.push_back(segments[j].second);
+			}
+			return group;
+		}
+	}
+	return {};
+}
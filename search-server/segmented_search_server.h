@@ -0,0 +1,145 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "search_server.h"
+
+// When SegmentedSearchServer seals and merges segments
+struct MergePolicy {
+    // Documents the in-memory segment takes before it is sealed into an immutable one
+    size_t max_memtable_documents = 10'000;
+    // This many sealed segments within a factor of merge_factor in size are merged into one
+    size_t merge_factor = 4;
+    // A sealed segment with at least this share of its documents removed is rewritten without them
+    double max_removed_ratio = 0.25;
+};
+
+// Index split into segments. New documents go into a small mutable in-memory segment, which is
+// sealed into an immutable one when it fills up; a background thread merges sealed segments of
+// similar size, so no write rebuilds the whole index. Queries run on every segment with the
+// document frequencies of the whole collection and merge the per-segment tops.
+// Queries and writes may run concurrently: the segment list is published as an immutable version
+// queries load without a lock. Only the in-memory segment and the tombstones of the sealed ones are
+// locked, by a query while it reads them and by a write while it adds or removes one document
+class SegmentedSearchServer {
+public:
+    explicit SegmentedSearchServer(std::string_view stop_words_text, MergePolicy policy = MergePolicy());
+
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+
+    // Stops the merge thread; a merge in progress is finished first
+    ~SegmentedSearchServer();
+
+    // Throws std::invalid_argument like SearchServer::AddDocument, also for ids of sealed segments
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // A document of a sealed segment is only added to the segment's tombstones, which queries skip
+    // and the next merge of the segment drops; MergePolicy::max_removed_ratio bounds how many pile up
+    void RemoveDocument(int document_id);
+
+    // FindTopDocuments(raw_query, DocumentStatus::ACTUAL, max_count) over all segments
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+    // Sealed segments, the in-memory one not counted
+    size_t GetSegmentCount() const;
+
+    // Blocks until the merge thread has nothing left to merge
+    void WaitForMerges();
+
+private:
+    struct Memtable {
+        mutable std::shared_mutex mutex;
+        SearchServer server;
+
+        explicit Memtable(const SearchServer& prototype)
+            : server(prototype) {
+        }
+    };
+
+    // Documents removed from a sealed segment and how many of them contain each word. Every version
+    // holding the segment shares them; they only change under write_mutex_ with mutex held
+    // exclusively, and queries hold mutex shared while they read them
+    struct Tombstones {
+        static constexpr uint32_t ID_FILTER_BITS = 1 << 16;
+
+        mutable std::shared_mutex mutex;
+        std::unordered_set<int> document_ids;
+        // Bit id % ID_FILTER_BITS of every removed id: queries test each posting against the
+        // tombstones, and most of them are answered here without a hash lookup
+        std::vector<uint64_t> id_filter = std::vector<uint64_t>(ID_FILTER_BITS / 64);
+        std::map<std::string, int, std::less<>> document_freqs;
+
+        // Adds a document of server
+        void Add(int document_id, const SearchServer& server);
+    };
+
+    // The member functions read the tombstones, so they expect tombstones->mutex or write_mutex_ to be held
+    struct Segment {
+        std::shared_ptr<const SearchServer> server;
+        std::shared_ptr<Tombstones> tombstones;
+
+        bool IsRemoved(int document_id) const;
+
+        int GetDocumentCount() const;
+
+        int GetDocumentFreq(std::string_view word) const;
+
+        // Share of the documents removed after the segment was sealed or before it
+        double GetRemovedRatio() const;
+    };
+
+    // Never changed once published; every write that changes the segment list publishes a new one
+    struct Version {
+        std::shared_ptr<Memtable> memtable;
+        std::vector<Segment> segments;
+    };
+
+    const MergePolicy policy_;
+    // Empty server with the stop words, copied for every new segment
+    const SearchServer prototype_;
+
+    // Serializes writes and merge installs; queries never take it
+    std::mutex write_mutex_;
+    // Accessed with std::atomic_load and std::atomic_store
+    std::shared_ptr<const Version> version_;
+
+    std::mutex merge_mutex_;
+    std::condition_variable merge_wake_;
+    std::condition_variable merge_idle_;
+    bool merge_requested_ = false;
+    bool merging_ = false;
+    bool stopping_ = false;
+    std::thread merge_thread_;
+
+    std::shared_ptr<const Version> LoadVersion() const;
+
+    // Expects write_mutex_ to be held
+    void Publish(std::shared_ptr<Memtable> memtable, std::vector<Segment> segments);
+
+    // Expects write_mutex_ to be held
+    void SealMemtable(const Version& version);
+
+    void RequestMerge();
+
+    void MergeLoop();
+
+    // Merges one group of segments; false when no group is due
+    bool MergeOnce();
+
+    // A segment with too many removed documents to rewrite, else segments of one size tier to merge,
+    // or none; takes the locks of the tombstones
+    std::vector<Segment> PickMergeGroup(const Version& version) const;
+};
@@ -0,0 +1,200 @@
+#include "shard_protocol.h"
+#include <utility>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+
+#ifdef _WIN32
+
+UnixSocket UnixSocket::Connect(const std::string&) {
+	throw std::runtime_error("unix domain sockets are not supported on this platform");
+}
+
+UnixSocket& UnixSocket::operator=(UnixSocket&& other) noexcept {
+	std::swap(fd_, other.fd_);
+	return *this;
+}
+
+UnixSocket::~UnixSocket() {
+}
+
+void UnixSocket::SendMessage(const std::vector<char>&) {
+}
+
+bool UnixSocket::ReceiveMessage(std::vector<char>&) {
+	return false;
+}
+
+void UnixSocket::Shutdown() {
+}
+
+UnixSocketListener::UnixSocketListener(const std::string&) {
+	throw std::runtime_error("unix domain sockets are not supported on this platform");
+}
+
+UnixSocketListener::~UnixSocketListener() {
+}
+
+UnixSocket UnixSocketListener::Accept() {
+	throw std::runtime_error("unix domain sockets are not supported on this platform");
+}
+
+void UnixSocketListener::Shutdown() {
+}
+
+#else
+
+namespace {
+
+sockaddr_un MakeAddress(const std::string& path) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("socket path is too long: "s + path);
+	}
+	path.copy(address.sun_path, path.size());
+	return address;
+}
+
+void SendAll(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error("can't send to socket");
+		}
+		data += sent;
+		size -= sent;
+	}
+}
+
+// Returns the number of bytes read before the peer closed the connection
+size_t ReceiveAll(int fd, char* data, size_t size) {
+	size_t received = 0;
+	while (received < size) {
+		const ssize_t count = recv(fd, data + received, size - received, 0);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error("can't receive from socket");
+		}
+		if (count == 0) {
+			break;
+		}
+		received += count;
+	}
+	return received;
+}
+
+}
+
+UnixSocket UnixSocket::Connect(const std::string& path) {
+	const sockaddr_un address = MakeAddress(path);
+	UnixSocket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+	if (socket.fd_ < 0) {
+		throw std::runtime_error("can't create socket");
+	}
+	if (connect(socket.fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+		throw std::runtime_error("can't connect to "s + path);
+	}
+	return socket;
+}
+
+UnixSocket& UnixSocket::operator=(UnixSocket&& other) noexcept {
+	std::swap(fd_, other.fd_);
+	return *this;
+}
+
+UnixSocket::~UnixSocket() {
+	if (fd_ >= 0) {
+		close(fd_);
+	}
+}
+
+void UnixSocket::SendMessage(const std::vector<char>& message) {
+	// One send for the header and the body, so small messages go out in a single packet
+	std::vector<char> frame(sizeof(uint32_t) + message.size());
+	const uint32_t size = static_cast<uint32_t>(message.size());
+	std::memcpy(frame.data(), &size, sizeof(size));
+	std::memcpy(frame.data() + sizeof(size), message.data(), message.size());
+	SendAll(fd_, frame.data(), frame.size());
+}
+
+bool UnixSocket::ReceiveMessage(std::vector<char>& message) {
+	uint32_t size;
+	const size_t header = ReceiveAll(fd_, reinterpret_cast<char*>(&size), sizeof(size));
+	if (header == 0) {
+		return false;
+	}
+	if (header != sizeof(size)) {
+		throw std::runtime_error("connection closed in a message");
+	}
+	message.resize(size);
+	if (ReceiveAll(fd_, message.data(), size) != size) {
+		throw std::runtime_error("connection closed in a message");
+	}
+	return true;
+}
+
+void UnixSocket::Shutdown() {
+	shutdown(fd_, SHUT_RDWR);
+}
+
+UnixSocketListener::UnixSocketListener(const std::string& path)
+	: path_(path) {
+	const sockaddr_un address = MakeAddress(path);
+	// Only a socket left by an earlier listener is replaced; any other file there is kept
+	struct stat existing;
+	if (lstat(path.c_str(), &existing) == 0) {
+		if (!S_ISSOCK(existing.st_mode)) {
+			throw std::runtime_error(path + " exists and is not a socket"s);
+		}
+		if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+			throw std::runtime_error("can't remove the old socket "s + path);
+		}
+	}
+	else if (errno != ENOENT) {
+		throw std::runtime_error("can't check "s + path);
+	}
+	fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd_ < 0) {
+		throw std::runtime_error("can't create socket");
+	}
+	if (bind(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(fd_, SOMAXCONN) != 0) {
+		close(fd_);
+		throw std::runtime_error("can't listen on "s + path);
+	}
+}
+
+UnixSocketListener::~UnixSocketListener() {
+	close(fd_);
+	unlink(path_.c_str());
+}
+
+UnixSocket UnixSocketListener::Accept() {
+	while (true) {
+		const int fd = accept(fd_, nullptr, nullptr);
+		if (fd >= 0) {
+			return UnixSocket(fd);
+		}
+		if (errno != EINTR) {
+			throw std::runtime_error("can't accept on "s + path_);
+		}
+	}
+}
+
+void UnixSocketListener::Shutdown() {
+	shutdown(fd_, SHUT_RDWR);
+}
+
+#endif
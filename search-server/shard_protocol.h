@@ -0,0 +1,139 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Wire format between shard processes and their clients on one host. A message is a uint32_t
+// length followed by that many bytes; values are raw in the host byte order, strings are a
+// uint32_t length and the characters. Requests start with a ShardRequest, responses with a
+// ShardStatus and, for errors, the message of the exception the shard threw
+enum class ShardRequest : uint8_t {
+    // raw_query -> document_count, [word, document_freq] for the plus words
+    STATISTICS = 1,
+    // raw_query, max_count, document_count, [word, document_freq] -> [id, relevance, rating]
+    FIND_TOP_DOCUMENTS = 2,
+    // raw_query, document_id -> [word], status
+    MATCH_DOCUMENT = 3,
+};
+
+enum class ShardStatus : uint8_t {
+    OK = 0,
+    INVALID_ARGUMENT = 1,
+    OUT_OF_RANGE = 2,
+    RUNTIME_ERROR = 3,
+};
+
+class MessageWriter {
+public:
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        bytes_.insert(bytes_.end(), bytes, bytes + sizeof(T));
+    }
+
+    void WriteString(std::string_view str) {
+        Write(static_cast<uint32_t>(str.size()));
+        bytes_.insert(bytes_.end(), str.begin(), str.end());
+    }
+
+    const std::vector<char>& GetBytes() const {
+        return bytes_;
+    }
+
+private:
+    std::vector<char> bytes_;
+};
+
+// Reads a received message; throws std::runtime_error past its end
+class MessageReader {
+public:
+    explicit MessageReader(const std::vector<char>& bytes)
+        : bytes_(bytes) {
+    }
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // A view into the message
+    std::string_view ReadString() {
+        const uint32_t size = Read<uint32_t>();
+        return { Take(size), size };
+    }
+
+private:
+    const std::vector<char>& bytes_;
+    size_t position_ = 0;
+
+    const char* Take(size_t size) {
+        if (size > bytes_.size() - position_) {
+            throw std::runtime_error("truncated message");
+        }
+        const char* data = bytes_.data() + position_;
+        position_ += size;
+        return data;
+    }
+};
+
+// Connected Unix domain stream socket. Throws std::runtime_error on failures;
+// on platforms without Unix domain sockets every constructor throws
+class UnixSocket {
+public:
+    // Connects to a listening socket at path
+    static UnixSocket Connect(const std::string& path);
+
+    explicit UnixSocket(int fd)
+        : fd_(fd) {
+    }
+
+    UnixSocket(UnixSocket&& other) noexcept
+        : fd_(other.fd_) {
+        other.fd_ = -1;
+    }
+
+    UnixSocket& operator=(UnixSocket&& other) noexcept;
+
+    ~UnixSocket();
+
+    void SendMessage(const std::vector<char>& message);
+
+    // False when the peer closed the connection between messages
+    bool ReceiveMessage(std::vector<char>& message);
+
+    // Makes blocked calls on this socket in other threads return
+    void Shutdown();
+
+private:
+    int fd_;
+};
+
+// Socket file at path accepting connections
+class UnixSocketListener {
+public:
+    // A socket file left at path is replaced; throws std::runtime_error if path is any other file
+    explicit UnixSocketListener(const std::string& path);
+
+    UnixSocketListener(const UnixSocketListener&) = delete;
+    UnixSocketListener& operator=(const UnixSocketListener&) = delete;
+
+    // Closes the socket and removes its file
+    ~UnixSocketListener();
+
+    // Throws std::runtime_error once Shutdown was called
+    UnixSocket Accept();
+
+    void Shutdown();
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
@@ -0,0 +1,26 @@
+#include "../search_server.h"
+#include "../shard_service.h"
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+// Serves one shard of a ShardedSearchServer, saved with SearchServer::SaveSnapshot, to
+// RemoteShardedSearchServer clients until the process is terminated
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "usage: "s << argv[0] << " <snapshot> <socket>"s << endl;
+        return 1;
+    }
+    try {
+        const SearchServer search_server = SearchServer::LoadSnapshot(argv[1]);
+        search_server.PrepareScoringTables();
+        ShardService service(search_server, argv[2]);
+        cerr << "serving "s << search_server.GetDocumentCount() << " documents on "s << argv[2] << endl;
+        service.Serve();
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
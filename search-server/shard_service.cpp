@@ -0,0 +1,172 @@
+#include "shard_service.h"
+#include "string_processing.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+void WriteStatistics(MessageWriter& writer, const SearchServer& search_server, std::string_view raw_query) {
+	std::vector<std::string_view> words;
+	for (std::string_view word : SplitIntoWords(raw_query)) {
+		// Minus words don't score; words the shard lacks would only be zeros
+		if (word[0] != '-' && search_server.GetDocumentFreq(word) > 0) {
+			words.push_back(word);
+		}
+	}
+	std::sort(words.begin(), words.end());
+	words.erase(std::unique(words.begin(), words.end()), words.end());
+
+	writer.Write<int32_t>(search_server.GetDocumentCount());
+	writer.Write<uint32_t>(static_cast<uint32_t>(words.size()));
+	for (const std::string_view word : words) {
+		writer.WriteString(word);
+		writer.Write<int32_t>(search_server.GetDocumentFreq(word));
+	}
+}
+
+void WriteTopDocuments(MessageWriter& writer, const SearchServer& search_server, MessageReader& reader) {
+	const std::string_view raw_query = reader.ReadString();
+	const uint64_t max_count = reader.Read<uint64_t>();
+	SearchServer::CollectionStatistics statistics;
+	statistics.document_count = reader.Read<int32_t>();
+	std::unordered_map<std::string_view, int> document_freqs;
+	for (uint32_t i = reader.Read<uint32_t>(); i > 0; --i) {
+		const std::string_view word = reader.ReadString();
+		document_freqs[word] = reader.Read<int32_t>();
+	}
+	statistics.document_freq = [&document_freqs](std::string_view word) {
+		const auto it = document_freqs.find(word);
+		return it != document_freqs.end() ? it->second : 0;
+	};
+
+	const std::vector<Document> documents = search_server.FindTopDocuments(raw_query, statistics, max_count);
+	writer.Write<uint32_t>(static_cast<uint32_t>(documents.size()));
+	for (const Document& document : documents) {
+		writer.Write<int32_t>(document.id);
+		writer.Write<double>(document.relevance);
+		writer.Write<int32_t>(document.rating);
+	}
+}
+
+void WriteMatchedWords(MessageWriter& writer, const SearchServer& search_server, MessageReader& reader) {
+	const std::string_view raw_query = reader.ReadString();
+	const int document_id = reader.Read<int32_t>();
+	const auto [words, status] = search_server.MatchDocument(raw_query, document_id);
+	writer.Write<uint32_t>(static_cast<uint32_t>(words.size()));
+	for (const std::string_view word : words) {
+		writer.WriteString(word);
+	}
+	writer.Write<int32_t>(static_cast<int32_t>(status));
+}
+
+std::vector<char> MakeError(ShardStatus status, const char* message) {
+	MessageWriter writer;
+	writer.Write(status);
+	writer.WriteString(message);
+	return writer.GetBytes();
+}
+
+}
+
+ShardService::ShardService(const SearchServer& search_server, const std::string& socket_path)
+	: search_server_(search_server)
+	, listener_(socket_path) {
+}
+
+ShardService::~ShardService() {
+	Stop();
+}
+
+void ShardService::Serve() {
+	while (true) {
+		UnixSocket socket(-1);
+		try {
+			socket = listener_.Accept();
+		}
+		catch (const std::runtime_error&) {
+			std::lock_guard lock(mutex_);
+			if (stopping_) {
+				break;
+			}
+			throw;
+		}
+		std::lock_guard lock(mutex_);
+		ReapFinishedConnections();
+		Connection& connection = connections_.emplace_back();
+		connection.socket = std::move(socket);
+		connection.thread = std::thread([this, &connection] { ServeConnection(connection); });
+	}
+
+	std::lock_guard lock(mutex_);
+	for (Connection& connection : connections_) {
+		connection.socket.Shutdown();
+	}
+	for (Connection& connection : connections_) {
+		connection.thread.join();
+	}
+	connections_.clear();
+}
+
+void ShardService::Stop() {
+	std::lock_guard lock(mutex_);
+	if (!stopping_) {
+		stopping_ = true;
+		listener_.Shutdown();
+	}
+}
+
+std::vector<char> ShardService::HandleRequest(const SearchServer& search_server, const std::vector<char>& request) {
+	try {
+		MessageReader reader(request);
+		MessageWriter writer;
+		writer.Write(ShardStatus::OK);
+		switch (reader.Read<ShardRequest>()) {
+		case ShardRequest::STATISTICS:
+			WriteStatistics(writer, search_server, reader.ReadString());
+			break;
+		case ShardRequest::FIND_TOP_DOCUMENTS:
+			WriteTopDocuments(writer, search_server, reader);
+			break;
+		case ShardRequest::MATCH_DOCUMENT:
+			WriteMatchedWords(writer, search_server, reader);
+			break;
+		default:
+			throw std::runtime_error("unknown request");
+		}
+		return writer.GetBytes();
+	}
+	catch (const std::invalid_argument& e) {
+		return MakeError(ShardStatus::INVALID_ARGUMENT, e.what());
+	}
+	catch (const std::out_of_range& e) {
+		return MakeError(ShardStatus::OUT_OF_RANGE, e.what());
+	}
+	catch (const std::exception& e) {
+		return MakeError(ShardStatus::RUNTIME_ERROR, e.what());
+	}
+}
+
+void ShardService::ServeConnection(Connection& connection) {
+	std::vector<char> request;
+	try {
+		while (connection.socket.ReceiveMessage(request)) {
+			connection.socket.SendMessage(HandleRequest(search_server_, request));
+		}
+	}
+	catch (const std::runtime_error&) {
+		// The client went away mid-message or the service is stopping
+	}
+	connection.finished.store(true, std::memory_order_release);
+}
+
+void ShardService::ReapFinishedConnections() {
+	for (auto it = connections_.begin(); it != connections_.end();) {
+		if (it->finished.load(std::memory_order_acquire)) {
+			it->thread.join();
+			it = connections_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
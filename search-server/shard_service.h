@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "search_server.h"
+#include "shard_protocol.h"
+
+// Serves one SearchServer to RemoteShardedSearchServer clients over a Unix domain socket,
+// one thread per connection; closed connections are cleaned up on the next accept.
+// The server must not change while it is served
+class ShardService {
+public:
+    // Starts listening at socket_path
+    ShardService(const SearchServer& search_server, const std::string& socket_path);
+
+    ShardService(const ShardService&) = delete;
+    ShardService& operator=(const ShardService&) = delete;
+
+    ~ShardService();
+
+    // Accepts connections until Stop is called from another thread
+    void Serve();
+
+    void Stop();
+
+    // Answers one request message; errors of the query are reported in the response
+    static std::vector<char> HandleRequest(const SearchServer& search_server, const std::vector<char>& request);
+
+private:
+    struct Connection {
+        UnixSocket socket{ -1 };
+        std::thread thread;
+        // Set by the connection's thread as it returns
+        std::atomic<bool> finished{ false };
+    };
+
+    const SearchServer& search_server_;
+    UnixSocketListener listener_;
+    std::mutex mutex_;
+    bool stopping_ = false;
+    std::list<Connection> connections_;
+
+    void ServeConnection(Connection& connection);
+
+    // Joins the threads of closed connections and frees their sockets; called with mutex_ held
+    void ReapFinishedConnections();
+};
@@ -0,0 +1,76 @@
+#include "sharded_search_server.h"
+#include <cstdint>
+#include <stdexcept>
+
+size_t GetShardIndex(int document_id, size_t shard_count) {
+	// Fibonacci hashing spreads runs of consecutive ids over all shards
+	const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>((hash >> 32) % shard_count);
+}
+
+ShardedSearchServer::ShardedSearchServer(std::string_view stop_words_text, size_t shard_count, QueryExecutor& executor)
+	: executor_(&executor) {
+	if (shard_count == 0) {
+		throw std::invalid_argument("no shards");
+	}
+	shards_.reserve(shard_count);
+	for (size_t i = 0; i < shard_count; ++i) {
+		shards_.emplace_back(stop_words_text);
+	}
+}
+
+void ShardedSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+	const std::vector<int>& ratings) {
+	// An id maps to one shard, so the shard's own check catches duplicates
+	shards_[GetShardIndex(document_id, shards_.size())].AddDocument(document_id, document, status, ratings);
+}
+
+std::vector<SearchServer::AddResult> ShardedSearchServer::AddDocuments(const std::vector<SearchServer::NewDocument>& documents) {
+	std::vector<std::vector<SearchServer::NewDocument>> batches(shards_.size());
+	std::vector<std::vector<size_t>> positions(shards_.size());
+	for (size_t i = 0; i < documents.size(); ++i) {
+		const size_t shard = documents[i].id < 0 ? 0 : GetShardIndex(documents[i].id, shards_.size());
+		batches[shard].push_back(documents[i]);
+		positions[shard].push_back(i);
+	}
+	std::vector<SearchServer::AddResult> results(documents.size());
+	executor_->ForEachIndex(shards_.size(), [&](size_t shard) {
+		const std::vector<SearchServer::AddResult> shard_results = shards_[shard].AddDocuments(batches[shard]);
+		for (size_t i = 0; i < shard_results.size(); ++i) {
+			results[positions[shard][i]] = shard_results[i];
+		}
+	});
+	return results;
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+	shards_[GetShardIndex(document_id, shards_.size())].RemoveDocument(document_id);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, size_t max_count) const {
+	std::vector<const SearchServer*> servers;
+	for (const SearchServer& shard : shards_) {
+		servers.push_back(&shard);
+	}
+	const SearchServer::CollectionStatistics statistics = SearchServer::GetCollectionStatistics(std::move(servers));
+
+	std::vector<std::vector<Document>> shard_results(shards_.size());
+	executor_->ForEachIndex(shards_.size(), [&](size_t shard) {
+		shard_results[shard] = shards_[shard].FindTopDocuments(raw_query, statistics, max_count);
+	});
+	TopDocuments top_documents(max_count);
+	for (const auto& documents : shard_results) {
+		for (const Document& document : documents) {
+			top_documents.Add(document);
+		}
+	}
+	return top_documents.Build();
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+	int document_count = 0;
+	for (const SearchServer& shard : shards_) {
+		document_count += shard.GetDocumentCount();
+	}
+	return document_count;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "search_server.h"
+#include "query_executor.h"
+
+// Shard of a document id among shard_count; every front end of the same shards must agree on it
+size_t GetShardIndex(int document_id, size_t shard_count);
+
+// Documents partitioned over shard_count SearchServer shards by a hash of the id. A query runs
+// on all shards at once on the executor, each shard scoring with the document frequencies of the
+// whole collection, so the merged top is the one of a single server holding every document. Term
+// scores are summed in word order on every shard, so the relevances are equal to the last bit as long
+// as dynamic pruning, which reorders the terms by their bounds, stays off.
+// Like SearchServer, changes must not overlap with queries. Queries on a shared executor run one
+// after another, and called from one of its threads, a query searches the shards on that thread
+class ShardedSearchServer {
+public:
+    ShardedSearchServer(std::string_view stop_words_text, size_t shard_count,
+        QueryExecutor& executor = QueryExecutor::GetDefault());
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // Every shard adds its part of the batch on the executor
+    std::vector<SearchServer::AddResult> AddDocuments(const std::vector<SearchServer::NewDocument>& documents);
+
+    void RemoveDocument(int document_id);
+
+    // FindTopDocuments(raw_query, DocumentStatus::ACTUAL, max_count) over all shards
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const {
+        return shards_.size();
+    }
+
+    const SearchServer& GetShard(size_t shard) const {
+        return shards_[shard];
+    }
+
+private:
+    std::vector<SearchServer> shards_;
+    QueryExecutor* executor_;
+};
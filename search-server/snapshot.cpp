@@ -0,0 +1,83 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace std::literals;
+
+namespace {
+
+constexpr size_t SNAPSHOT_ALIGNMENT = 8;
+// Read back in another byte order it turns into a different number
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+	: path_(path)
+	, temp_path_(path + ".tmp"s)
+	, out_(temp_path_, std::ios::binary | std::ios::trunc) {
+	if (!out_) {
+		throw std::runtime_error("can't create "s + temp_path_);
+	}
+	WriteBytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	Write(SNAPSHOT_VERSION);
+	Write(BYTE_ORDER_MARK);
+	Write(static_cast<uint8_t>(sizeof(size_t)));
+	Write(static_cast<uint8_t>(sizeof(int)));
+}
+
+SnapshotWriter::~SnapshotWriter() {
+	if (!finished_) {
+		out_.close();
+		std::remove(temp_path_.c_str());
+	}
+}
+
+void SnapshotWriter::Finish() {
+	out_.close();
+	if (!out_) {
+		throw std::runtime_error("failed to write the snapshot");
+	}
+	// rename replaces the target in one step; readers of the old file keep its inode
+	if (std::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+		throw std::runtime_error("can't replace "s + path_);
+	}
+	finished_ = true;
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+	out_.write(static_cast<const char*>(data), size);
+	position_ += size;
+}
+
+void SnapshotWriter::Align() {
+	static constexpr char padding[SNAPSHOT_ALIGNMENT] = {};
+	WriteBytes(padding, (SNAPSHOT_ALIGNMENT - position_ % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT);
+}
+
+SnapshotReader::SnapshotReader(const std::string& path)
+	: file_(MappedFile::Open(path)) {
+	if (file_->size() < sizeof(SNAPSHOT_MAGIC) || std::memcmp(file_->data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+		throw std::runtime_error(path + " is not a search index snapshot"s);
+	}
+	position_ = sizeof(SNAPSHOT_MAGIC);
+	if (Read<uint32_t>() != SNAPSHOT_VERSION) {
+		throw std::runtime_error("unsupported snapshot version in "s + path);
+	}
+	if (Read<uint32_t>() != BYTE_ORDER_MARK || Read<uint8_t>() != sizeof(size_t) || Read<uint8_t>() != sizeof(int)) {
+		throw std::runtime_error(path + " was written on an incompatible platform"s);
+	}
+}
+
+const char* SnapshotReader::Take(size_t size) {
+	if (size > file_->size() - position_) {
+		throw std::runtime_error("truncated snapshot");
+	}
+	const char* data = file_->data() + position_;
+	position_ += size;
+	return data;
+}
+
+void SnapshotReader::Align() {
+	position_ = std::min(file_->size(), (position_ + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT);
+}
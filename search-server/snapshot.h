@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "mapped_array.h"
+#include "mapped_file.h"
+
+// Binary index snapshot format. Arrays are stored raw and 8-byte aligned, so a reader can
+// hand out views straight into the mapped file instead of deserializing them. The format
+// follows the writer's byte order and type sizes; the header rejects files from other platforms
+inline constexpr char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+inline constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+class SnapshotWriter {
+public:
+    // Writes to path + ".tmp", which Finish renames to path, so a save that fails or crashes
+    // leaves the previous file intact, and readers that still map it keep their pages.
+    // Throws std::runtime_error if the file can't be created
+    explicit SnapshotWriter(const std::string& path);
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Removes the temporary file unless Finish succeeded
+    ~SnapshotWriter();
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t size) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Write<uint64_t>(size);
+        Align();
+        WriteBytes(data, size * sizeof(T));
+    }
+
+    void WriteString(std::string_view str) {
+        WriteArray(str.data(), str.size());
+    }
+
+    // Flushes the file and moves it to the target path; throws std::runtime_error if anything
+    // failed to reach it
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    bool finished_ = false;
+    uint64_t position_ = 0;
+
+    void WriteBytes(const void* data, size_t size);
+    void Align();
+};
+
+class SnapshotReader {
+public:
+    // Maps the file and checks its header; throws std::runtime_error for foreign or damaged files
+    explicit SnapshotReader(const std::string& path);
+
+    const std::shared_ptr<const MappedFile>& GetFile() const {
+        return file_;
+    }
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // A view into the mapped file, valid while GetFile() is alive
+    template <typename T>
+    MappedArray<T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const uint64_t size = Read<uint64_t>();
+        Align();
+        if (size > (file_->size() - position_) / sizeof(T)) {
+            throw std::runtime_error("truncated snapshot");
+        }
+        return MappedArray<T>::View(reinterpret_cast<const T*>(Take(size * sizeof(T))), size);
+    }
+
+    std::string_view ReadString() {
+        const MappedArray<char> chars = ReadArray<char>();
+        return { chars.data(), chars.size() };
+    }
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_ = 0;
+
+    const char* Take(size_t size);
+    void Align();
+};
@@ -0,0 +1,28 @@
+#include "stop_word_filter.h"
+#include <cstring>
+
+uint64_t StopWordFilter::Hash(std::string_view word) {
+	// The first and last 8 bytes and the length; longer words only cost an extra compare on a tie
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	std::memcpy(&head, word.data(), std::min<size_t>(word.size(), 8));
+	if (word.size() > 8) {
+		std::memcpy(&tail, word.data() + word.size() - 8, 8);
+	}
+	uint64_t hash = (head ^ (tail * 0x9e3779b97f4a7c15ull) ^ word.size()) * 0xff51afd7ed558ccdull;
+	return hash ^ (hash >> 29);
+}
+
+void StopWordFilter::Insert(std::string_view word) {
+	if (Contains(word)) {
+		return;
+	}
+	length_mask_ |= uint64_t{ 1 } << std::min<size_t>(word.size(), 63);
+	const uint64_t hash = Hash(word);
+	size_t slot = hash & (slots_.size() - 1);
+	while (slots_[slot].length != EMPTY) {
+		slot = (slot + 1) & (slots_.size() - 1);
+	}
+	slots_[slot] = { hash, static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(word.size()) };
+	chars_ += word;
+}
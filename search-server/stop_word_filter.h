@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of stop words built once. A bit per word length rejects most tokens
+// before any hashing; the rest take one O(1) hash of the first and last 8 bytes and
+// usually a single probe of a flat open addressing table
+class StopWordFilter {
+public:
+    StopWordFilter() = default;
+
+    template <typename StringContainer>
+    explicit StopWordFilter(const StringContainer& words);
+
+    bool Contains(std::string_view word) const {
+        if (((length_mask_ >> std::min<size_t>(word.size(), 63)) & 1) == 0) {
+            return false;
+        }
+        const uint64_t hash = Hash(word);
+        for (size_t slot = hash & (slots_.size() - 1);; slot = (slot + 1) & (slots_.size() - 1)) {
+            const Slot& entry = slots_[slot];
+            if (entry.length == EMPTY) {
+                return false;
+            }
+            if (entry.hash == hash && std::string_view(chars_.data() + entry.offset, entry.length) == word) {
+                return true;
+            }
+        }
+    }
+
+private:
+    inline static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t offset;
+        uint32_t length = EMPTY;
+    };
+
+    // Bit n is set if some word has n characters; bit 63 stands for all longer words
+    uint64_t length_mask_ = 0;
+    std::string chars_;
+    std::vector<Slot> slots_;
+
+    static uint64_t Hash(std::string_view word);
+
+    void Insert(std::string_view word);
+};
+
+template <typename StringContainer>
+StopWordFilter::StopWordFilter(const StringContainer& words) {
+    // At most a quarter full, so probes stay short
+    size_t slot_count = 1;
+    while (slot_count < words.size() * 4) {
+        slot_count *= 2;
+    }
+    slots_.resize(slot_count);
+    for (std::string_view word : words) {
+        Insert(word);
+    }
+}
@@ -1,15 +1,119 @@
 #include "string_processing.h"
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPLIT_INTO_WORDS_BLOCK_SIZE 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPLIT_INTO_WORDS_BLOCK_SIZE 16
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 using namespace std;
 
+namespace {
+
+bool IsControlChar(char c) {
+    return c >= '\0' && c < ' ';
+}
+
+#ifdef SPLIT_INTO_WORDS_BLOCK_SIZE
+
+constexpr size_t BLOCK_SIZE = SPLIT_INTO_WORDS_BLOCK_SIZE;
+constexpr uint32_t BLOCK_MASK = BLOCK_SIZE == 32 ? 0xffffffffu : (1u << BLOCK_SIZE) - 1;
+
+// Bit i describes byte i of the block
+struct BlockMasks {
+    uint32_t spaces;
+    uint32_t control_chars;
+};
+
+BlockMasks ScanBlock(const char* data) {
+#if SPLIT_INTO_WORDS_BLOCK_SIZE == 32
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    // Signed comparisons, so bytes above 127 are never control characters
+    const __m256i control_chars = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(-1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), bytes));
+    return { static_cast<uint32_t>(_mm256_movemask_epi8(spaces)), static_cast<uint32_t>(_mm256_movemask_epi8(control_chars)) };
+#else
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // Signed comparisons, so bytes above 127 are never control characters
+    const __m128i control_chars = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1)),
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8(' ')));
+    return { static_cast<uint32_t>(_mm_movemask_epi8(spaces)), static_cast<uint32_t>(_mm_movemask_epi8(control_chars)) };
+#endif
+}
+
+int CountTrailingZeros(uint32_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+#endif
+
+}
+
 vector<string_view> SplitIntoWords(string_view text) {
+    bool has_control_chars = false;
+    return SplitIntoWords(text, has_control_chars);
+}
+
+vector<string_view> SplitIntoWords(string_view text, bool& has_control_chars) {
     vector<string_view> result;
-    text.remove_prefix(std::min(text.find_first_not_of(" "), text.size()));
+    has_control_chars = false;
+    bool in_word = false;
+    size_t word_begin = 0;
+    size_t pos = 0;
+
+#ifdef SPLIT_INTO_WORDS_BLOCK_SIZE
+    uint32_t control_chars = 0;
+    for (; pos + BLOCK_SIZE <= text.size(); pos += BLOCK_SIZE) {
+        const BlockMasks masks = ScanBlock(text.data() + pos);
+        control_chars |= masks.control_chars;
+        // A word starts or ends wherever a byte differs from the one before it in being a space
+        const uint32_t non_spaces = ~masks.spaces & BLOCK_MASK;
+        uint32_t boundaries = (non_spaces ^ (non_spaces << 1 | static_cast<uint32_t>(in_word))) & BLOCK_MASK;
+        while (boundaries != 0) {
+            const size_t boundary = pos + CountTrailingZeros(boundaries);
+            boundaries &= boundaries - 1;
+            if (in_word) {
+                result.push_back(text.substr(word_begin, boundary - word_begin));
+            }
+            else {
+                word_begin = boundary;
+            }
+            in_word = !in_word;
+        }
+    }
+    has_control_chars = control_chars != 0;
+#endif
 
-    while (!text.empty()) {
-        int64_t space = text.find(' ');
-        result.push_back(text.substr(0, space));
-        text.remove_prefix(std::min(text.find_first_of(" "), text.size()));
-        text.remove_prefix(std::min(text.find_first_of(" ") + text.find_first_not_of(" "), text.size()));
+    // The tail shorter than a block, or everything without SIMD
+    for (; pos < text.size(); ++pos) {
+        has_control_chars |= IsControlChar(text[pos]);
+        if (in_word == (text[pos] == ' ')) {
+            if (in_word) {
+                result.push_back(text.substr(word_begin, pos - word_begin));
+            }
+            else {
+                word_begin = pos;
+            }
+            in_word = !in_word;
+        }
+    }
+    if (in_word) {
+        result.push_back(text.substr(word_begin));
     }
     return result;
-}
\ No newline at end of file
+}
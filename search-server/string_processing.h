@@ -8,6 +8,10 @@
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str);
 
+// Same words, and reports whether the text holds control characters (bytes 0-31) found in the
+// same pass. Scans 32 or 16 bytes at a time with AVX2 or SSE2 when the target has them
+std::vector<std::string_view> SplitIntoWords(std::string_view str, bool& has_control_chars);
+
 template <typename StringContainer>
 std::set<std::string,std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string,std::less<>> non_empty_strings;
@@ -0,0 +1,130 @@
+#include "term_dictionary.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <string>
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+	: blocks_(other.blocks_)
+	, terms_(other.terms_)
+	, hashes_(other.hashes_)
+	, slots_(other.slots_) {
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+	if (this != &other) {
+		TermDictionary copy(other);
+		*this = std::move(copy);
+	}
+	return *this;
+}
+
+uint32_t TermDictionary::Intern(std::string_view term) {
+	if ((terms_.size() + 1) * 2 > slots_.size()) {
+		Grow();
+	}
+	const uint64_t hash = Hash(term);
+	const size_t slot = FindSlot(term, hash);
+	if (slots_[slot] != NO_TERM) {
+		return slots_[slot];
+	}
+	const uint32_t term_id = static_cast<uint32_t>(terms_.size());
+	terms_.push_back(Store(term));
+	hashes_.Mutable().push_back(hash);
+	slots_.Mutable()[slot] = term_id;
+	return term_id;
+}
+
+uint32_t TermDictionary::Find(std::string_view term) const {
+	if (slots_.empty()) {
+		return NO_TERM;
+	}
+	return slots_[FindSlot(term, Hash(term))];
+}
+
+void TermDictionary::SaveSnapshot(SnapshotWriter& writer) const {
+	std::string chars;
+	std::vector<uint64_t> offsets = { 0 };
+	for (const std::string_view term : terms_) {
+		chars += term;
+		offsets.push_back(chars.size());
+	}
+	writer.WriteString(chars);
+	writer.WriteArray(offsets.data(), offsets.size());
+	writer.WriteArray(hashes_.data(), hashes_.size());
+	writer.WriteArray(slots_.data(), slots_.size());
+}
+
+void TermDictionary::LoadSnapshot(SnapshotReader& reader) {
+	const std::string_view chars = reader.ReadString();
+	const MappedArray<uint64_t> offsets = reader.ReadArray<uint64_t>();
+	hashes_ = reader.ReadArray<uint64_t>();
+	slots_ = reader.ReadArray<uint32_t>();
+	const bool slots_valid = slots_.empty() ? hashes_.empty() : (slots_.size() & (slots_.size() - 1)) == 0 && slots_.size() > hashes_.size();
+	if (offsets.empty() || offsets.back() != chars.size() || hashes_.size() + 1 != offsets.size() || !slots_valid
+		|| !std::is_sorted(offsets.begin(), offsets.end())) {
+		throw std::runtime_error("damaged term dictionary in snapshot");
+	}
+	// Lookups index the terms with the slots and probe until a free slot
+	size_t used_slots = 0;
+	for (const uint32_t term_id : slots_) {
+		if (term_id != NO_TERM && term_id >= hashes_.size()) {
+			throw std::runtime_error("damaged term dictionary in snapshot");
+		}
+		used_slots += term_id != NO_TERM;
+	}
+	if (used_slots != hashes_.size()) {
+		throw std::runtime_error("damaged term dictionary in snapshot");
+	}
+	blocks_.clear();
+	block_used_ = BLOCK_SIZE;
+	terms_.clear();
+	terms_.reserve(hashes_.size());
+	for (size_t term_id = 0; term_id < hashes_.size(); ++term_id) {
+		terms_.push_back(chars.substr(offsets[term_id], offsets[term_id + 1] - offsets[term_id]));
+	}
+}
+
+uint64_t TermDictionary::Hash(std::string_view term) {
+	// 64-bit FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (const char c : term) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string_view TermDictionary::Store(std::string_view term) {
+	if (term.size() > BLOCK_SIZE - block_used_) {
+		blocks_.emplace_back(new char[std::max(term.size(), BLOCK_SIZE)]);
+		block_used_ = 0;
+	}
+	char* data = blocks_.back().get() + block_used_;
+	std::copy(term.begin(), term.end(), data);
+	// An oversized term fills its own block
+	block_used_ = std::min(block_used_ + term.size(), BLOCK_SIZE);
+	return { data, term.size() };
+}
+
+size_t TermDictionary::FindSlot(std::string_view term, uint64_t hash) const {
+	const size_t mask = slots_.size() - 1;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+		const uint32_t term_id = slots_[slot];
+		if (term_id == NO_TERM || (hashes_[term_id] == hash && terms_[term_id] == term)) {
+			return slot;
+		}
+	}
+}
+
+void TermDictionary::Grow() {
+	const size_t slot_count = std::max<size_t>(16, slots_.size() * 2);
+	std::vector<uint32_t>& slots = slots_.Mutable();
+	slots.assign(slot_count, NO_TERM);
+	const size_t mask = slot_count - 1;
+	for (uint32_t term_id = 0; term_id < terms_.size(); ++term_id) {
+		size_t slot = hashes_[term_id] & mask;
+		while (slots[slot] != NO_TERM) {
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = term_id;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "mapped_array.h"
+
+class SnapshotWriter;
+class SnapshotReader;
+
+// Interns every distinct word as a dense uint32_t term id.
+// The characters live in an append-only arena of fixed blocks, so the
+// string_view handed out for a term stays valid for the dictionary's lifetime
+class TermDictionary {
+public:
+    inline static constexpr uint32_t NO_TERM = std::numeric_limits<uint32_t>::max();
+
+    TermDictionary() = default;
+    // Copies share the filled arena blocks and append to fresh ones
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns the id of term, registering it first if needed
+    uint32_t Intern(std::string_view term);
+
+    // Returns NO_TERM for unknown terms
+    uint32_t Find(std::string_view term) const;
+
+    std::string_view GetTerm(uint32_t term_id) const {
+        return terms_[term_id];
+    }
+
+    size_t size() const {
+        return terms_.size();
+    }
+
+    void SaveSnapshot(SnapshotWriter& writer) const;
+
+    // Terms and the hash table view the mapped file; only the term views are rebuilt
+    void LoadSnapshot(SnapshotReader& reader);
+
+private:
+    inline static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::shared_ptr<char[]>> blocks_;
+    size_t block_used_ = BLOCK_SIZE;
+    std::vector<std::string_view> terms_;
+    // Hashes are stored in snapshots, so they must not depend on the standard library
+    MappedArray<uint64_t> hashes_;
+    // Open addressing table of term ids, its size is a power of two
+    MappedArray<uint32_t> slots_;
+
+    static uint64_t Hash(std::string_view term);
+
+    std::string_view Store(std::string_view term);
+    size_t FindSlot(std::string_view term, uint64_t hash) const;
+    void Grow();
+};
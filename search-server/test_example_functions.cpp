@@ -1,5 +1,24 @@
 #include "test_example_functions.h"
 #include "search_server.h"
+#include "corpus_loader.h"
+#include "process_queries.h"
+#include "concurrent_search_server.h"
+#include "segmented_search_server.h"
+#include "sharded_search_server.h"
+#include "shard_service.h"
+#include "remote_sharded_search_server.h"
+#include "remove_duplicates.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <type_traits>
 
 using namespace std;
 
@@ -79,6 +98,16 @@ void TestMatching() {
 		ASSERT_EQUAL(static_cast<int>(get<1>(found_docs_2)), static_cast<int>(DocumentStatus::ACTUAL));
 		const auto found_docs_3 = server.MatchDocument("cat walking -the -white"s, 42);
 		ASSERT(get<0>(found_docs_3).empty());
+
+		// The query is checked before the id
+		bool rejected = false;
+		try {
+			server.MatchDocument("cat --walking"s, 7);
+		}
+		catch (const invalid_argument&) {
+			rejected = true;
+		}
+		ASSERT(rejected);
 	}
 }
 
@@ -158,6 +187,1192 @@ void TestPredicatAndRelevanceCalc() {
 	ASSERT_EQUAL(found_docs_3[1].id, 2);
 }
 
+void TestRemoveDocument() {
+	SearchServer server(""s);
+	server.AddDocument(7, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(3, "dog in the park"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(5, "cat and dog"s, DocumentStatus::ACTUAL, { 3 });
+
+	const vector<int> all_ids(server.begin(), server.end());
+	ASSERT_EQUAL(all_ids, vector<int>({ 3, 5, 7 }));
+
+	server.RemoveDocument(5);
+	server.RemoveDocument(execution::par, 7);
+	ASSERT_EQUAL(server.GetDocumentCount(), 1);
+	ASSERT_EQUAL(vector<int>(server.begin(), server.end()), vector<int>({ 3 }));
+	ASSERT(server.FindTopDocuments("cat"s).empty());
+	ASSERT(server.GetWordFrequencies(7).empty());
+
+	server.AddDocument(7, "cat on the roof"s, DocumentStatus::ACTUAL, { 4 });
+	const auto found_docs = server.FindTopDocuments("cat"s);
+	ASSERT_EQUAL(found_docs.size(), 1u);
+	ASSERT_EQUAL(found_docs[0].id, 7);
+	ASSERT_EQUAL(found_docs[0].rating, 4);
+}
+
+void TestTopDocumentsCount() {
+	SearchServer server("and"s);
+	for (int id = 0; id < 20; ++id) {
+		const string content = id % 3 == 0 ? "cat and dog"s : id % 3 == 1 ? "cat cat bird"s : "fish only"s;
+		server.AddDocument(id, content, DocumentStatus::ACTUAL, { id });
+	}
+
+	ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 5u);
+	const auto found_docs = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 10);
+	ASSERT_EQUAL(found_docs.size(), 10u);
+	ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0).empty());
+
+	// "cat cat bird" documents rank first, ties are broken by the higher rating
+	ASSERT_EQUAL(found_docs[0].id, 19);
+	ASSERT_EQUAL(found_docs[1].id, 16);
+	for (size_t i = 1; i < found_docs.size(); ++i) {
+		ASSERT(!TopDocuments::IsBetter(found_docs[i], found_docs[i - 1]));
+	}
+	ASSERT_EQUAL(server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, 10).size(), 10u);
+
+	// No buffer is sized by max_count up front
+	const size_t no_limit = numeric_limits<size_t>::max();
+	ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, no_limit).size(), 14u);
+	ASSERT_EQUAL(server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, no_limit).size(), 14u);
+}
+
+void TestInverseDocumentFreqCache() {
+	SearchServer server(""s);
+	server.AddDocument(0, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(1, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+	const auto before = server.FindTopDocuments("cat"s);
+	ASSERT(abs(before[0].relevance - 0.5 * log(2.0)) < 1e-6);
+
+	// Adding documents changes the document count, the cached values must follow
+	server.AddDocument(2, "grey mouse"s, DocumentStatus::ACTUAL, { 3 });
+	server.AddDocument(3, "tabby cat"s, DocumentStatus::ACTUAL, { 4 });
+	const auto after = server.FindTopDocuments("cat"s);
+	ASSERT_EQUAL(after.size(), 2u);
+	ASSERT(abs(after[0].relevance - 0.5 * log(2.0)) < 1e-6);
+
+	const auto plain = server.FindTopDocuments("white cat mouse"s);
+	server.SetPrecomputedImpacts(true);
+	const auto with_impacts = server.FindTopDocuments("white cat mouse"s);
+	ASSERT_EQUAL(plain.size(), with_impacts.size());
+	for (size_t i = 0; i < plain.size(); ++i) {
+		ASSERT_EQUAL(plain[i].id, with_impacts[i].id);
+		ASSERT(abs(plain[i].relevance - with_impacts[i].relevance) < 1e-6);
+	}
+	server.RemoveDocument(2);
+	ASSERT(server.FindTopDocuments("mouse"s).empty());
+	ASSERT(abs(server.FindTopDocuments("white"s)[0].relevance - 0.5 * log(3.0)) < 1e-6);
+}
+
+void TestDynamicPruning() {
+	mt19937 generator;
+	vector<string> dictionary;
+	for (int i = 0; i < 300; ++i) {
+		dictionary.push_back("w"s + to_string(i));
+	}
+	const auto random_text = [&generator, &dictionary](int word_count, double minus_prob) {
+		string text;
+		for (int i = 0; i < word_count; ++i) {
+			if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+				text += '-';
+			}
+			// Skewed choice, so terms get very different upper bounds
+			const int index = uniform_int_distribution<>(0, 299)(generator) * uniform_int_distribution<>(0, 299)(generator) / 299;
+			text += dictionary[index] + ' ';
+		}
+		return text;
+	};
+
+	SearchServer server("w0"s);
+	for (int id = 0; id < 2000; ++id) {
+		server.AddDocument(id, random_text(uniform_int_distribution<>(1, 30)(generator), 0.0), DocumentStatus::ACTUAL,
+			{ uniform_int_distribution<>(-5, 5)(generator) });
+	}
+	const auto odd_ids = [](int document_id, DocumentStatus, int) { return document_id % 2 == 1; };
+	for (int i = 0; i < 200; ++i) {
+		const string query = random_text(uniform_int_distribution<>(1, 20)(generator), 0.1);
+		for (const size_t max_count : { 1u, 5u, 50u }) {
+			server.SetDynamicPruning(false);
+			const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+			const auto expected_odd = server.FindTopDocuments(query, odd_ids, max_count);
+			server.SetDynamicPruning(true);
+			const auto found = server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+			const auto found_odd = server.FindTopDocuments(query, odd_ids, max_count);
+			const auto found_par = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, max_count);
+			ASSERT_EQUAL(found.size(), expected.size());
+			ASSERT_EQUAL(found_odd.size(), expected_odd.size());
+			ASSERT_EQUAL(found_par.size(), expected.size());
+			for (size_t j = 0; j < expected.size(); ++j) {
+				ASSERT_EQUAL(found[j].id, expected[j].id);
+				// Terms are summed in a different order, so only rounding may differ
+				ASSERT(abs(found[j].relevance - expected[j].relevance) < 1e-12);
+				ASSERT_EQUAL(found_par[j].id, expected[j].id);
+			}
+			for (size_t j = 0; j < expected_odd.size(); ++j) {
+				ASSERT_EQUAL(found_odd[j].id, expected_odd[j].id);
+			}
+		}
+	}
+}
+
+void TestPostingListBlocks() {
+	mt19937 generator;
+	PostingList postings;
+	map<int, uint32_t> expected;
+	// Out of order ids go through block splits
+	for (int i = 0; i < 3000; ++i) {
+		const int document_id = uniform_int_distribution<>(0, 5000)(generator);
+		postings.Add(document_id, 2, 0.5);
+		expected[document_id] += 2;
+	}
+	ASSERT_EQUAL(postings.size(), expected.size());
+
+	map<int, uint32_t> decoded;
+	size_t next_position = 0;
+	postings.ForEach(0, numeric_limits<int>::max(), [&decoded, &next_position](size_t position, int document_id, uint32_t term_count) {
+		ASSERT_EQUAL(position, next_position++);
+		decoded[document_id] = term_count;
+	});
+	ASSERT(decoded == expected);
+	ASSERT(postings.GetMaxTermFreq(0, 5001) >= 0.5);
+
+	PostingList::Cursor cursor(postings);
+	for (int document_id = 0; document_id <= 5001; document_id += 7) {
+		const auto it = expected.lower_bound(document_id);
+		ASSERT_EQUAL(cursor.SeekTo(document_id), it != expected.end());
+		if (it != expected.end()) {
+			ASSERT_EQUAL(cursor.GetDocumentId(), it->first);
+			ASSERT_EQUAL(cursor.GetTermCount(), it->second);
+		}
+		ASSERT_EQUAL(postings.Contains(document_id), expected.count(document_id) > 0);
+	}
+}
+
+void TestIndexSnapshot() {
+	const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+	SearchServer server("and in on"s);
+	server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+	server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+	server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { 5, -12, 2, 1 });
+	server.AddDocument(5, "groomed starling evgeniy"s, DocumentStatus::ACTUAL, { 9 });
+	server.RemoveDocument(3);
+	server.SaveSnapshot(path);
+
+	{
+		SearchServer loaded = SearchServer::LoadSnapshot(path);
+		ASSERT_EQUAL(loaded.GetDocumentCount(), 3);
+		ASSERT(vector<int>(loaded.begin(), loaded.end()) == vector<int>({ 1, 2, 5 }));
+		ASSERT(loaded.GetWordFrequencies(2) == server.GetWordFrequencies(2));
+		for (const string& query : { "fluffy groomed cat"s, "cat -collar"s, "and"s, "dog"s }) {
+			const auto expected = server.FindTopDocuments(query);
+			const auto found = loaded.FindTopDocuments(query);
+			ASSERT_EQUAL(found.size(), expected.size());
+			for (size_t i = 0; i < found.size(); ++i) {
+				ASSERT_EQUAL(found[i].id, expected[i].id);
+				ASSERT_EQUAL(found[i].rating, expected[i].rating);
+				ASSERT(abs(found[i].relevance - expected[i].relevance) < 1e-12);
+			}
+		}
+		const auto [words, status] = loaded.MatchDocument("fluffy cat -collar"s, 2);
+		ASSERT(words == vector<string_view>({ "cat"sv, "fluffy"sv }));
+
+		// Changes copy the mapped arrays and leave the source server alone
+		loaded.AddDocument(7, "fluffy dog"s, DocumentStatus::ACTUAL, { 1 });
+		loaded.RemoveDocument(1);
+		ASSERT_EQUAL(loaded.FindTopDocuments("dog"s).size(), 1u);
+		ASSERT_EQUAL(loaded.FindTopDocuments("white"s).size(), 0u);
+		ASSERT_EQUAL(server.FindTopDocuments("white"s).size(), 1u);
+	}
+	{
+		// Saving over a snapshot replaces the file, so a server still mapping the old one keeps working
+		const SearchServer mapped = SearchServer::LoadSnapshot(path);
+		SearchServer other("and in on"s);
+		other.AddDocument(9, "bald parrot"s, DocumentStatus::ACTUAL, { 4 });
+		other.SaveSnapshot(path);
+		ASSERT(!filesystem::exists(path + ".tmp"s));
+		ASSERT_EQUAL(SearchServer::LoadSnapshot(path).GetDocumentCount(), 1);
+		ASSERT_EQUAL(mapped.FindTopDocuments("fluffy cat"s).size(), 2u);
+		ASSERT(mapped.GetWordFrequencies(2) == server.GetWordFrequencies(2));
+		server.SaveSnapshot(path);
+	}
+
+	const auto read_file = [](const string& file_path) {
+		ifstream in(file_path, ios::binary);
+		return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	};
+	const string bytes = read_file(path);
+	{
+		// Nothing uninitialized reaches the file, so the same index always gives the same bytes
+		const string same_path = path + ".same"s;
+		SearchServer same("and in on"s);
+		same.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+		same.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+		same.AddDocument(5, "groomed starling evgeniy"s, DocumentStatus::ACTUAL, { 9 });
+		same.SaveSnapshot(same_path);
+		ASSERT(read_file(same_path) == bytes);
+		filesystem::remove(same_path);
+	}
+
+	// Any damaged byte is rejected or leaves a server whose arrays and postings agree
+	for (size_t i = 0; i < bytes.size(); ++i) {
+		string damaged = bytes;
+		damaged[i] = static_cast<char>(~damaged[i]);
+		{
+			ofstream out(path, ios::binary | ios::trunc);
+			out << damaged;
+		}
+		try {
+			const SearchServer loaded = SearchServer::LoadSnapshot(path);
+			for (const string& query : { "fluffy groomed cat"s, "cat -collar"s }) {
+				loaded.FindTopDocuments(query);
+			}
+			for (const int document_id : loaded) {
+				loaded.GetWordFrequencies(document_id);
+			}
+		}
+		catch (const runtime_error&) {
+		}
+	}
+
+	bool rejected = false;
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		out << "not a snapshot"s;
+	}
+	try {
+		SearchServer::LoadSnapshot(path);
+	}
+	catch (const runtime_error&) {
+		rejected = true;
+	}
+	ASSERT(rejected);
+	filesystem::remove(path);
+}
+
+void TestAddDocuments() {
+	using AddResult = SearchServer::AddResult;
+	// Literals, so the texts outlive the batch
+	const vector<SearchServer::NewDocument> documents = {
+		{ 1, "white cat and fashionable collar", DocumentStatus::ACTUAL, { 8, -3 } },
+		{ 2, "fluffy cat fluffy tail", DocumentStatus::ACTUAL, { 7, 2, 7 } },
+		{ 2, "groomed dog", DocumentStatus::ACTUAL, { 1 } },
+		{ -4, "groomed dog", DocumentStatus::ACTUAL, { 1 } },
+		{ 5, "groomed d\x12og", DocumentStatus::ACTUAL, { 1 } },
+		{ 6, "groomed - dog", DocumentStatus::ACTUAL, { 1 } },
+		{ 7, "groomed --dog", DocumentStatus::ACTUAL, { 1 } },
+		{ 8, "groomed dog expressive eyes", DocumentStatus::BANNED, { 5, -12, 2, 1 } },
+		{ 0, "-groomed starling evgeniy", DocumentStatus::ACTUAL, { 9 } },
+	};
+	const vector<AddResult> expected_results = { AddResult::ADDED, AddResult::ADDED, AddResult::INAPPROPRIATE_ID,
+		AddResult::INAPPROPRIATE_ID, AddResult::INAPPROPRIATE_SYMBOLS, AddResult::WRONG_MINUS_WORD_FORMAT,
+		AddResult::WRONG_MINUS_WORD_FORMAT, AddResult::ADDED, AddResult::ADDED };
+
+	SearchServer expected("and"s);
+	for (const auto& document : documents) {
+		try {
+			expected.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		catch (const invalid_argument&) {
+		}
+	}
+
+	for (const bool par : { false, true }) {
+		SearchServer server("and"s);
+		server.SetParallelism(3);
+		const auto results = par ? server.AddDocuments(execution::par, documents) : server.AddDocuments(documents);
+		ASSERT(results == expected_results);
+		ASSERT(vector<int>(server.begin(), server.end()) == vector<int>(expected.begin(), expected.end()));
+		for (const int id : server) {
+			ASSERT(server.GetWordFrequencies(id) == expected.GetWordFrequencies(id));
+		}
+		for (const string& query : { "fluffy groomed cat"s, "dog -eyes"s, "-groomed"s, "starling"s }) {
+			const auto found = server.FindTopDocuments(query, [](int, DocumentStatus, int) { return true; });
+			const auto wanted = expected.FindTopDocuments(query, [](int, DocumentStatus, int) { return true; });
+			ASSERT_EQUAL(found.size(), wanted.size());
+			for (size_t i = 0; i < found.size(); ++i) {
+				ASSERT_EQUAL(found[i].id, wanted[i].id);
+				ASSERT_EQUAL(found[i].rating, wanted[i].rating);
+				ASSERT(abs(found[i].relevance - wanted[i].relevance) < 1e-12);
+			}
+		}
+		ASSERT_EQUAL(server.AddDocuments({ { 1, "cat", DocumentStatus::ACTUAL, {} } })[0], AddResult::INAPPROPRIATE_ID);
+	}
+}
+
+void TestLoadCorpus() {
+	using AddResult = SearchServer::AddResult;
+	const string path = (filesystem::temp_directory_path() / "search_server_test.corpus"s).string();
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		out << "1\tACTUAL\t8 -3\twhite cat and fashionable collar\n"s
+			<< "2\tACTUAL\t7 2 7\tfluffy cat fluffy tail\r\n"s
+			<< "\n"s
+			<< "2\tBANNED\t1\tgroomed dog\n"s
+			<< "3\tBANNED\t\tgroomed dog expressive eyes"s;
+	}
+	SearchServer server("and"s);
+	// A batch size of 1 runs every line through its own pipeline step
+	const auto results = LoadCorpus(server, path, 1);
+	ASSERT(results == vector<AddResult>({ AddResult::ADDED, AddResult::ADDED, AddResult::INAPPROPRIATE_ID, AddResult::ADDED }));
+	ASSERT_EQUAL(server.GetDocumentCount(), 3);
+	ASSERT_EQUAL(server.FindTopDocuments("fluffy"s)[0].rating, 5);
+	ASSERT_EQUAL(server.FindTopDocuments("tail"s).size(), 1u);
+	ASSERT_EQUAL(server.FindTopDocuments("eyes"s, DocumentStatus::BANNED)[0].rating, 0);
+
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		out << "4\tACTUAL\t1\tblack cat\n"s << "5\tACTIVE\t1\tblack dog\n"s;
+	}
+	bool rejected = false;
+	try {
+		LoadCorpus(server, path);
+	}
+	catch (const invalid_argument&) {
+		rejected = true;
+	}
+	ASSERT(rejected);
+	filesystem::remove(path);
+}
+
+void TestSplitIntoWords() {
+	mt19937 generator;
+	// Spaces, control characters and bytes above 127 at every offset of a block
+	const string alphabet = "  ab\t\x01\x1f\x7f\xd0\xb0-"s;
+	for (int i = 0; i < 2000; ++i) {
+		string text;
+		const int length = uniform_int_distribution<>(0, 100)(generator);
+		for (int j = 0; j < length; ++j) {
+			text += alphabet[uniform_int_distribution<size_t>(0, alphabet.size() - 1)(generator)];
+		}
+		vector<string_view> expected;
+		for (size_t begin = text.find_first_not_of(' '); begin != string::npos; begin = text.find_first_not_of(' ', begin)) {
+			const size_t end = min(text.find(' ', begin), text.size());
+			expected.push_back(string_view(text).substr(begin, end - begin));
+			begin = end;
+		}
+		bool has_control_chars = false;
+		ASSERT(SplitIntoWords(text, has_control_chars) == expected);
+		ASSERT_EQUAL(has_control_chars, any_of(text.begin(), text.end(), [](char c) { return c >= '\0' && c < ' '; }));
+	}
+
+	SearchServer server(""s);
+	server.AddDocument(1, "a long enough document to fill a whole block"s, DocumentStatus::ACTUAL, {});
+	bool rejected = false;
+	try {
+		server.FindTopDocuments("a long enough query to fill a whole bl\x12ock"s);
+	}
+	catch (const invalid_argument&) {
+		rejected = true;
+	}
+	ASSERT(rejected);
+}
+
+void TestStopWordFilter() {
+	mt19937 generator;
+	const auto random_word = [&generator](int max_length) {
+		string word(uniform_int_distribution<>(1, max_length)(generator), 'a');
+		for (char& c : word) {
+			c = static_cast<char>(uniform_int_distribution<>('a', 'c')(generator));
+		}
+		return word;
+	};
+	set<string, less<>> words;
+	for (int i = 0; i < 300; ++i) {
+		words.insert(random_word(20));
+	}
+	// Same first and last 8 bytes and length, so only the full compare tells them apart
+	words.insert("aaaaaaaabbbbcccccccc"s);
+	const StopWordFilter filter(words);
+	ASSERT(filter.Contains("aaaaaaaabbbbcccccccc"sv));
+	ASSERT(!filter.Contains("aaaaaaaabcbbcccccccc"sv));
+	ASSERT(!filter.Contains(""sv));
+	for (int i = 0; i < 5000; ++i) {
+		const string word = random_word(80);
+		ASSERT_EQUAL(filter.Contains(word), words.count(word) > 0);
+	}
+	for (const string& word : words) {
+		ASSERT(filter.Contains(word));
+	}
+	ASSERT(!StopWordFilter().Contains("a"sv));
+	ASSERT(!StopWordFilter(vector<string>{}).Contains("a"sv));
+}
+
+void TestQueryCache() {
+	SearchServer server("and in"s);
+	server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+	server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+	server.SetQueryCache(2, true);
+
+	const auto first = server.FindTopDocuments("fluffy cat"s);
+	const auto second = server.FindTopDocuments("fluffy cat"s);
+	ASSERT_EQUAL(second.size(), first.size());
+	ASSERT_EQUAL(second[0].id, first[0].id);
+	ASSERT_EQUAL(server.GetQueryResultCacheStats().hits, 1u);
+	// Predicates can't be cached as results, but their query plan can
+	server.FindTopDocuments("fluffy cat"s, [](int, DocumentStatus, int) { return true; });
+	ASSERT_EQUAL(server.GetQueryPlanCacheStats().hits, 1u);
+
+	// A new document changes the epoch, so the cached results are stale
+	server.AddDocument(3, "fluffy dog"s, DocumentStatus::ACTUAL, { 1 });
+	ASSERT_EQUAL(server.FindTopDocuments("dog"s).size(), 1u);
+	ASSERT_EQUAL(server.FindTopDocuments("fluffy cat"s).size(), 3u);
+	ASSERT_EQUAL(server.GetQueryResultCacheStats().stale, 1u);
+
+	server.FindTopDocuments("white"s);
+	ASSERT(server.GetQueryResultCacheStats().evictions > 0);
+
+	for (int i = 0; i < 2; ++i) {
+		bool rejected = false;
+		try {
+			server.FindTopDocuments("--cat"s);
+		}
+		catch (const invalid_argument&) {
+			rejected = true;
+		}
+		ASSERT(rejected);
+	}
+
+	server.SetQueryCache(0);
+	server.FindTopDocuments("fluffy cat"s);
+	ASSERT_EQUAL(server.GetQueryPlanCacheStats().misses, 0u);
+}
+
+void TestQueryExecutor() {
+	{
+		QueryExecutor executor(4);
+		ASSERT_EQUAL(executor.GetThreadCount(), 4u);
+		std::vector<std::atomic<int>> calls(1000);
+		executor.ForEachIndex(calls.size(), [&calls](size_t i) { ++calls[i]; });
+		for (const auto& count : calls) {
+			ASSERT_EQUAL(count.load(), 1);
+		}
+		// Threads are kept between batches
+		std::atomic<int> total = 0;
+		executor.ForEachIndex(0, [&total](size_t) { ++total; });
+		executor.ForEachIndex(10, [&total](size_t) { ++total; });
+		ASSERT_EQUAL(total.load(), 10);
+
+		bool thrown = false;
+		try {
+			executor.ForEachIndex(100, [](size_t i) {
+				if (i == 42) {
+					throw std::out_of_range("42"s);
+				}
+			});
+		}
+		catch (const std::out_of_range&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+	}
+	{
+		SearchServer search_server("and with"s);
+		search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+		search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+		search_server.AddDocument(3, "big cat nasty hair"s, DocumentStatus::ACTUAL, { 1, 2, 8 });
+		const std::vector<std::string> queries = { "nasty rat -not"s, "not very funny nasty pet"s, "curly hair"s, "dog"s };
+		QueryExecutor executor(3);
+		const auto results = ProcessQueries(executor, search_server, queries);
+		ASSERT_EQUAL(results.size(), queries.size());
+		size_t total = 0;
+		for (size_t i = 0; i < queries.size(); ++i) {
+			const auto expected = search_server.FindTopDocuments(queries[i]);
+			ASSERT_EQUAL(results[i].size(), expected.size());
+			for (size_t j = 0; j < expected.size(); ++j) {
+				ASSERT_EQUAL(results[i][j].id, expected[j].id);
+			}
+			total += expected.size();
+		}
+		ASSERT_EQUAL(ProcessQueriesJoined(search_server, queries).size(), total);
+
+		// Batches started on the executor's own threads run inline instead of waiting for the pool
+		std::atomic<size_t> nested_total = 0;
+		executor.ForEachIndex(queries.size(), [&](size_t) {
+			nested_total += ProcessQueriesJoined(executor, search_server, queries).size();
+		});
+		ASSERT_EQUAL(nested_total.load(), total * queries.size());
+		std::packaged_task<size_t()> task([&] { return ProcessQueriesJoined(executor, search_server, queries).size(); });
+		std::future<size_t> posted = task.get_future();
+		executor.Post([&task] { task(); });
+		ASSERT(posted.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+		ASSERT_EQUAL(posted.get(), total);
+	}
+}
+
+void TestProcessQueriesJoined() {
+	SearchServer search_server("and with"s);
+	for (int id = 1; id <= 8; ++id) {
+		search_server.AddDocument(id, "funny pet nasty rat "s + std::to_string(id), DocumentStatus::ACTUAL, { id });
+	}
+	search_server.AddDocument(9, "curly hair"s, DocumentStatus::ACTUAL, { 1 });
+	// Queries without results leave empty slots the view has to skip, the first one included
+	const std::vector<std::string> queries = { "dog"s, "funny rat"s, "cat"s, "curly"s, "parrot"s };
+	const JoinedDocuments joined = ProcessQueriesJoinedView(search_server, queries);
+	const std::vector<Document> joined_copy = ProcessQueriesJoined(search_server, queries);
+
+	std::vector<Document> expected;
+	for (size_t i = 0; i < queries.size(); ++i) {
+		const auto documents = search_server.FindTopDocuments(queries[i]);
+		const auto [first, last] = joined.GetQueryDocuments(i);
+		ASSERT_EQUAL(static_cast<size_t>(last - first), documents.size());
+		expected.insert(expected.end(), documents.begin(), documents.end());
+	}
+	ASSERT_EQUAL(joined.size(), expected.size());
+	ASSERT_EQUAL(joined.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT + 1));
+	ASSERT_EQUAL(joined_copy.size(), expected.size());
+	size_t i = 0;
+	for (const Document& document : joined) {
+		ASSERT_EQUAL(document.id, expected[i].id);
+		ASSERT_EQUAL(document.rating, expected[i].rating);
+		ASSERT_EQUAL(joined_copy[i].id, expected[i].id);
+		++i;
+	}
+	ASSERT_EQUAL(i, expected.size());
+
+	// Forward iterator requirements: default construction, multiple passes, post-increment and ->
+	ASSERT(std::is_default_constructible_v<JoinedDocuments::Iterator>);
+	ASSERT(JoinedDocuments::Iterator() == JoinedDocuments::Iterator());
+	ASSERT_EQUAL(static_cast<size_t>(std::distance(joined.begin(), joined.end())), expected.size());
+	const std::vector<Document> range_copy(joined.begin(), joined.end());
+	ASSERT_EQUAL(range_copy.size(), expected.size());
+	JoinedDocuments::Iterator it = joined.begin();
+	const JoinedDocuments::Iterator first = it++;
+	ASSERT(first == joined.begin());
+	ASSERT(it == std::next(joined.begin()));
+	ASSERT_EQUAL(first->id, expected[0].id);
+	ASSERT_EQUAL(it->id, expected[1].id);
+
+	ASSERT(ProcessQueriesJoinedView(search_server, { "dog"s }).empty());
+	ASSERT(ProcessQueriesJoined(search_server, {}).empty());
+	const JoinedDocuments no_queries = ProcessQueriesJoinedView(search_server, {});
+	ASSERT(no_queries.begin() == no_queries.end());
+}
+
+void TestCancellableQueries() {
+	SearchServer search_server("and with"s);
+	search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+	search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+	search_server.AddDocument(3, "big cat nasty hair"s, DocumentStatus::ACTUAL, { 1, 2, 8 });
+	const std::string query = "curly nasty cat"s;
+	const auto expected = search_server.FindTopDocuments(query);
+
+	for (const bool pruning : { false, true }) {
+		search_server.SetDynamicPruning(pruning);
+		const auto result = search_server.FindTopDocuments(query, CancellationToken());
+		ASSERT(result.complete);
+		ASSERT_EQUAL(result.documents.size(), expected.size());
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQUAL(result.documents[i].id, expected[i].id);
+		}
+
+		CancellationToken token;
+		token.Cancel();
+		const auto cancelled = search_server.FindTopDocuments(query, token);
+		ASSERT(!cancelled.complete);
+		ASSERT(cancelled.documents.empty());
+
+		const auto expired = search_server.FindTopDocuments(query, CancellationToken::WithTimeout(-std::chrono::seconds(1)));
+		ASSERT(!expired.complete);
+	}
+	search_server.SetDynamicPruning(false);
+
+	// A copy of the token cancels the query it was handed to
+	CancellationToken token;
+	const CancellationToken copy = token;
+	token.Cancel();
+	ASSERT(copy.IsCancelled());
+	ASSERT(!CancellationToken::WithTimeout(std::chrono::hours(1)).IsCancelled());
+
+	for (const size_t threads : { 1, 3 }) {
+		QueryExecutor executor(threads);
+		std::vector<std::future<SearchServer::QueryResult>> futures;
+		for (int i = 0; i < 10; ++i) {
+			futures.push_back(search_server.FindTopDocumentsAsync(query, CancellationToken(), MAX_RESULT_DOCUMENT_COUNT, executor));
+		}
+		futures.push_back(search_server.FindTopDocumentsAsync(query, copy, MAX_RESULT_DOCUMENT_COUNT, executor));
+		for (int i = 0; i < 10; ++i) {
+			const auto result = futures[i].get();
+			ASSERT(result.complete);
+			ASSERT_EQUAL(result.documents.size(), expected.size());
+		}
+		ASSERT(!futures.back().get().complete);
+	}
+}
+
+void TestConcurrentSearchServer() {
+	ConcurrentSearchServer server(SearchServer("and with"s));
+	server.AddDocuments({ { 1, "funny pet and nasty rat"sv, DocumentStatus::ACTUAL, { 7, 2, 7 } } });
+	ASSERT_EQUAL(server.GetVersion(), 2u);
+
+	// A pinned version doesn't see later changes
+	const auto pinned = server.GetSnapshot();
+	server.Update([](SearchServer& search_server) {
+		search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+		search_server.RemoveDocument(1);
+	});
+	ASSERT_EQUAL(pinned->GetDocumentCount(), 1);
+	ASSERT_EQUAL(pinned->FindTopDocuments("rat"s).size(), 1u);
+	ASSERT_EQUAL(server.GetSnapshot()->GetDocumentCount(), 1);
+	ASSERT(server.GetSnapshot()->FindTopDocuments("rat"s).empty());
+	ASSERT_EQUAL(server.GetVersion(), 3u);
+
+	// A failed change publishes nothing
+	const auto before = server.GetSnapshot();
+	try {
+		server.Update([](SearchServer& search_server) {
+			search_server.AddDocument(3, "big cat"s, DocumentStatus::ACTUAL, { 1 });
+			search_server.AddDocument(2, "duplicate id"s, DocumentStatus::ACTUAL, { 1 });
+		});
+		ASSERT(false);
+	}
+	catch (const std::invalid_argument&) {
+	}
+	ASSERT(server.GetSnapshot() == before);
+	ASSERT_EQUAL(server.GetVersion(), 3u);
+
+	// Readers query while a writer keeps publishing
+	std::atomic<bool> done = false;
+	std::thread reader([&server, &done] {
+		while (!done) {
+			const auto snapshot = server.GetSnapshot();
+			const auto documents = snapshot->FindTopDocuments("funny cat"s);
+			ASSERT(documents.size() <= static_cast<size_t>(snapshot->GetDocumentCount()));
+		}
+	});
+	std::vector<std::string> texts;
+	for (int id = 10; id < 60; ++id) {
+		texts.push_back("funny cat number "s + std::to_string(id));
+	}
+	for (int first = 10; first < 60; first += 10) {
+		std::vector<SearchServer::NewDocument> batch;
+		for (int id = first; id < first + 10; ++id) {
+			batch.push_back({ id, texts[id - 10], DocumentStatus::ACTUAL, { id } });
+		}
+		server.AddDocuments(batch);
+	}
+	server.RemoveDocuments({ 10, 11, 404 });
+	done = true;
+	reader.join();
+	ASSERT_EQUAL(server.GetSnapshot()->GetDocumentCount(), 49);
+	ASSERT_EQUAL(server.GetVersion(), 9u);
+}
+
+void TestSegmentedSearchServer() {
+	const std::vector<std::string> texts = {
+		"funny pet and nasty rat"s, "funny pet with curly hair"s, "big cat nasty hair"s, "big dog cat Vladislav"s,
+		"big dog hamster Borya"s, "big cat fancy collar"s, "curly dog and fancy collar"s, "nasty rat with curly tail"s,
+		"small cat"s, "funny funny dog"s, "hamster with a nasty tail"s, "big nasty cat and a small rat"s,
+	};
+	SearchServer monolithic("and with"s);
+	SegmentedSearchServer segmented("and with"s, MergePolicy{ 3, 2 });
+	for (size_t i = 0; i < texts.size(); ++i) {
+		const int id = static_cast<int>(i) + 1;
+		monolithic.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id });
+		segmented.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id });
+	}
+	ASSERT_EQUAL(segmented.GetDocumentCount(), monolithic.GetDocumentCount());
+	try {
+		segmented.AddDocument(2, "duplicate of a sealed id"s, DocumentStatus::ACTUAL, { 1 });
+		ASSERT(false);
+	}
+	catch (const std::invalid_argument&) {
+	}
+
+	// Scores use the whole collection, so they match the monolithic index whatever the segments are
+	const auto check = [&](const std::string& query) {
+		const auto expected = monolithic.FindTopDocuments(query);
+		const auto documents = segmented.FindTopDocuments(query);
+		ASSERT_EQUAL_HINT(documents.size(), expected.size(), query);
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQUAL_HINT(documents[i].id, expected[i].id, query);
+			ASSERT_EQUAL_HINT(documents[i].relevance, expected[i].relevance, query);
+		}
+	};
+	const std::vector<std::string> queries = { "nasty cat"s, "curly dog -hamster"s, "funny rat tail"s, "big"s, "parrot"s };
+	for (const std::string& query : queries) {
+		check(query);
+	}
+
+	segmented.WaitForMerges();
+	ASSERT(segmented.GetSegmentCount() < texts.size() / 3);
+	for (const std::string& query : queries) {
+		check(query);
+	}
+
+	// Sealed and in-memory documents alike
+	monolithic.AddDocument(13, "fancy rat"s, DocumentStatus::ACTUAL, { 1 });
+	segmented.AddDocument(13, "fancy rat"s, DocumentStatus::ACTUAL, { 1 });
+	for (const int id : { 1, 13 }) {
+		monolithic.RemoveDocument(id);
+		segmented.RemoveDocument(id);
+	}
+	ASSERT_EQUAL(segmented.GetDocumentCount(), monolithic.GetDocumentCount());
+	for (const std::string& query : queries) {
+		check(query);
+	}
+
+	// The id of a tombstoned document is free again, and merges drop the tombstoned copy
+	const std::vector<std::string> more_texts = {
+		"funny rat with a fancy tail"s, "small dog"s, "curly cat"s, "nasty parrot"s, "big parrot"s, "small rat"s, "funny cat"s,
+	};
+	for (size_t i = 0; i < more_texts.size(); ++i) {
+		const int id = i == 0 ? 1 : static_cast<int>(i) + 13;
+		monolithic.AddDocument(id, more_texts[i], DocumentStatus::ACTUAL, { id });
+		segmented.AddDocument(id, more_texts[i], DocumentStatus::ACTUAL, { id });
+	}
+	ASSERT_EQUAL(segmented.GetDocumentCount(), monolithic.GetDocumentCount());
+	for (const std::string& query : queries) {
+		check(query);
+	}
+	segmented.WaitForMerges();
+	ASSERT_EQUAL(segmented.GetDocumentCount(), monolithic.GetDocumentCount());
+	for (const std::string& query : queries) {
+		check(query);
+	}
+
+	// Enough removals from sealed segments get them rewritten without the removed documents
+	for (const int id : { 2, 3, 4, 5, 6, 7 }) {
+		monolithic.RemoveDocument(id);
+		segmented.RemoveDocument(id);
+	}
+	segmented.WaitForMerges();
+	ASSERT_EQUAL(segmented.GetDocumentCount(), monolithic.GetDocumentCount());
+	for (const std::string& query : queries) {
+		check(query);
+	}
+}
+
+void TestShardedSearchServer() {
+	std::mt19937 generator(7);
+	const std::vector<std::string> words = { "cat"s, "dog"s, "rat"s, "funny"s, "nasty"s, "curly"s, "big"s, "tail"s, "and"s };
+	std::vector<std::string> texts;
+	for (int i = 0; i < 200; ++i) {
+		std::string text;
+		for (int j = 0; j < 6; ++j) {
+			text += words[generator() % words.size()] + ' ';
+		}
+		texts.push_back(text);
+	}
+
+	SearchServer single("and"s);
+	ShardedSearchServer sharded("and"s, 4);
+	std::vector<SearchServer::NewDocument> batch;
+	for (size_t i = 0; i < texts.size(); ++i) {
+		const int id = static_cast<int>(i);
+		single.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id % 7 });
+		if (i % 2 == 0) {
+			sharded.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id % 7 });
+		} else {
+			batch.push_back({ id, texts[i], DocumentStatus::ACTUAL, { id % 7 } });
+		}
+	}
+	batch.push_back({ 0, "duplicate"sv, DocumentStatus::ACTUAL, { 1 } });
+	const auto results = sharded.AddDocuments(batch);
+	ASSERT(results.back() == SearchServer::AddResult::INAPPROPRIATE_ID);
+	ASSERT_EQUAL(sharded.GetDocumentCount(), single.GetDocumentCount());
+	for (size_t shard = 0; shard < sharded.GetShardCount(); ++shard) {
+		ASSERT(sharded.GetShard(shard).GetDocumentCount() > 0);
+	}
+
+	single.RemoveDocument(3);
+	sharded.RemoveDocument(3);
+	// Every shard scores with the global statistics; only the order the term scores are summed in,
+	// which follows each shard's own term ids, may differ
+	for (const std::string& query : { "cat"s, "funny nasty -tail"s, "curly dog rat"s, "parrot"s }) {
+		const auto expected = single.FindTopDocuments(query);
+		const auto documents = sharded.FindTopDocuments(query);
+		ASSERT_EQUAL_HINT(documents.size(), expected.size(), query);
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQUAL_HINT(documents[i].id, expected[i].id, query);
+			ASSERT_EQUAL_HINT(documents[i].relevance, expected[i].relevance, query);
+		}
+	}
+}
+
+void TestRemoteShards() {
+	ShardedSearchServer local("and with"s, 2);
+	local.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+	local.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+	local.AddDocument(3, "big cat nasty hair"s, DocumentStatus::BANNED, { 1, 2, 8 });
+	local.AddDocument(4, "big dog cat Vladislav"s, DocumentStatus::ACTUAL, { 1, 3, 2 });
+	local.AddDocument(5, "big dog hamster Borya"s, DocumentStatus::ACTUAL, { 1, 1, 1 });
+
+	// Malformed requests are answered, not thrown
+	const std::vector<char> truncated = { static_cast<char>(ShardRequest::FIND_TOP_DOCUMENTS), 1 };
+	const std::vector<char> response = ShardService::HandleRequest(local.GetShard(0), truncated);
+	ASSERT(static_cast<ShardStatus>(response[0]) == ShardStatus::RUNTIME_ERROR);
+
+	const auto directory = std::filesystem::temp_directory_path();
+	std::vector<std::string> paths;
+	std::vector<std::unique_ptr<ShardService>> services;
+	std::vector<std::thread> threads;
+	for (size_t shard = 0; shard < local.GetShardCount(); ++shard) {
+		paths.push_back((directory / ("search_server_test_shard_"s + std::to_string(shard) + ".sock"s)).string());
+		services.push_back(std::make_unique<ShardService>(local.GetShard(shard), paths.back()));
+		threads.emplace_back([&service = *services.back()] { service.Serve(); });
+	}
+	{
+		const RemoteShardedSearchServer remote(paths);
+		for (const std::string& query : { "nasty cat"s, "big dog -hamster"s, "funny curly rat"s, "parrot"s }) {
+			const auto expected = local.FindTopDocuments(query);
+			const auto documents = remote.FindTopDocuments(query);
+			ASSERT_EQUAL_HINT(documents.size(), expected.size(), query);
+			for (size_t i = 0; i < expected.size(); ++i) {
+				ASSERT_EQUAL_HINT(documents[i].id, expected[i].id, query);
+				ASSERT_EQUAL_HINT(documents[i].relevance, expected[i].relevance, query);
+				ASSERT_EQUAL_HINT(documents[i].rating, expected[i].rating, query);
+			}
+		}
+
+		const auto [words, status] = remote.MatchDocument("nasty cat -dog"s, 3);
+		ASSERT(status == DocumentStatus::BANNED);
+		ASSERT(words == std::vector<std::string>({ "cat"s, "nasty"s }));
+
+		// Shard errors come back as the exceptions SearchServer throws, and the connections stay usable
+		bool thrown = false;
+		try {
+			remote.FindTopDocuments("cat --dog"s);
+		}
+		catch (const std::invalid_argument&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+		thrown = false;
+		try {
+			remote.MatchDocument("cat"s, 42);
+		}
+		catch (const std::out_of_range&) {
+			thrown = true;
+		}
+		ASSERT(thrown);
+		ASSERT_EQUAL(remote.FindTopDocuments("dog"s).size(), 2u);
+	}
+
+	// The closed connections are cleaned up as new ones arrive
+	const RemoteShardedSearchServer remote(paths);
+	ASSERT_EQUAL(remote.FindTopDocuments("dog"s).size(), 2u);
+	services[1]->Stop();
+	threads[1].join();
+	bool thrown = false;
+	try {
+		remote.FindTopDocuments("dog"s);
+	}
+	catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	ASSERT(thrown);
+	// After a transport error the shards may be out of step, so even the live one is refused
+	const int id_on_live_shard = GetShardIndex(1, 2) == 0 ? 1 : 2;
+	ASSERT(GetShardIndex(id_on_live_shard, 2) == 0);
+	thrown = false;
+	try {
+		remote.MatchDocument("pet"s, id_on_live_shard);
+	}
+	catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	ASSERT(thrown);
+	services[0]->Stop();
+	threads[0].join();
+
+	// A listener replaces only a socket left at its path, never another file
+	const std::string file_path = (directory / "search_server_test_not_a_socket"s).string();
+	{
+		std::ofstream out(file_path);
+		out << "data"s;
+	}
+	thrown = false;
+	try {
+		UnixSocketListener listener(file_path);
+	}
+	catch (const std::runtime_error&) {
+		thrown = true;
+	}
+	ASSERT(thrown);
+	ASSERT(std::filesystem::is_regular_file(file_path));
+	std::filesystem::remove(file_path);
+	{
+		const UnixSocketListener old_listener(paths[0]);
+		const UnixSocketListener new_listener(paths[0]);
+		ASSERT(std::filesystem::is_socket(paths[0]));
+	}
+}
+
+void TestRemoveDocumentTombstones() {
+	const std::vector<std::string> texts = { "cat with curly tail"s, "dog with big ears"s, "rare parrot"s,
+		"cat and dog"s, "curly dog"s, "big cat"s };
+	SearchServer server("with and"s);
+	SearchServer expected_server("with and"s);
+	for (size_t i = 0; i < texts.size(); ++i) {
+		const int id = static_cast<int>(i);
+		server.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id });
+		if (id != 2) {
+			expected_server.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { id });
+		}
+	}
+
+	server.RemoveDocument(2);
+	server.RemoveDocument(42);
+	ASSERT_EQUAL(server.GetDocumentCount(), 5);
+	ASSERT_EQUAL(server.GetRemovedDocumentCount(), 1);
+	ASSERT_EQUAL(server.GetDocumentFreq("parrot"s), 0);
+	ASSERT(server.FindTopDocuments("rare parrot"s).empty());
+	// Removed documents don't count towards the idf, before compaction and after it
+	const auto check_queries = [&server, &expected_server]() {
+		for (const std::string& query : { "cat"s, "curly dog -ears"s, "big parrot"s }) {
+			for (const bool pruning : { false, true }) {
+				server.SetDynamicPruning(pruning);
+				const auto expected = expected_server.FindTopDocuments(query);
+				const auto documents = server.FindTopDocuments(query);
+				ASSERT_EQUAL_HINT(documents.size(), expected.size(), query);
+				for (size_t i = 0; i < expected.size(); ++i) {
+					ASSERT_EQUAL_HINT(documents[i].id, expected[i].id, query);
+					ASSERT_EQUAL_HINT(documents[i].relevance, expected[i].relevance, query);
+				}
+			}
+		}
+	};
+	check_queries();
+	bool rejected = false;
+	try {
+		server.MatchDocument("parrot"s, 2);
+	}
+	catch (const out_of_range&) {
+		rejected = true;
+	}
+	ASSERT(rejected);
+
+	server.Compact();
+	ASSERT_EQUAL(server.GetRemovedDocumentCount(), 0);
+	ASSERT_EQUAL(server.GetDocumentCount(), 5);
+	check_queries();
+
+	// An id can come back after its removal
+	server.AddDocument(2, "rare parrot"s, DocumentStatus::ACTUAL, { 2 });
+	ASSERT_EQUAL(server.GetDocumentFreq("parrot"s), 1);
+
+	// Removals never compact on their own, so word views stay valid until Compact
+	const auto [words, status] = server.MatchDocument("parrot"s, 2);
+	for (const int id : { 0, 1, 2, 3 }) {
+		server.RemoveDocument(id);
+	}
+	ASSERT_EQUAL(server.GetDocumentCount(), 2);
+	ASSERT_EQUAL(server.GetRemovedDocumentCount(), 4);
+	ASSERT(words == vector<string_view>{ "parrot"sv });
+	ASSERT_EQUAL(server.FindTopDocuments("cat dog"s).size(), 2u);
+	server.Compact();
+	ASSERT_EQUAL(server.GetRemovedDocumentCount(), 0);
+	ASSERT_EQUAL(server.FindTopDocuments("cat dog"s).size(), 2u);
+}
+
+void TestRemoveDuplicates() {
+	SearchServer server("and with"s);
+	server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+	server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+	// Same words as 2: order, counts and stop words don't matter
+	server.AddDocument(3, "curly hair curly hair funny pet"s, DocumentStatus::ACTUAL, { 1, 2 });
+	server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+	// A subset and a superset of 1 are not duplicates
+	server.AddDocument(5, "funny pet nasty"s, DocumentStatus::ACTUAL, { 1, 2 });
+	server.AddDocument(6, "funny pet nasty rat rat big"s, DocumentStatus::ACTUAL, { 1, 2 });
+	server.AddDocument(7, "rat nasty pet funny"s, DocumentStatus::BANNED, { 1, 2 });
+
+	RemoveDuplicates(server);
+	ASSERT_EQUAL(vector<int>(server.begin(), server.end()), (vector<int>{ 1, 2, 5, 6 }));
+}
+
+void TestNearDuplicates() {
+	string base;
+	for (int i = 0; i < 20; ++i) {
+		base += "word"s + to_string(i) + ' ';
+	}
+	SearchServer server("and"s);
+	server.AddDocument(1, base, DocumentStatus::ACTUAL, { 1 });
+	// 20 words in common out of 21
+	server.AddDocument(2, base + "extra"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(3, "word0 word1 word2 word3 other words entirely"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(4, "and "s + base, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(5, "other words entirely"s, DocumentStatus::ACTUAL, { 1 });
+
+	const auto duplicates = FindNearDuplicates(server);
+	ASSERT_EQUAL(duplicates.size(), 2u);
+	ASSERT_EQUAL(duplicates[0].document_id, 2);
+	ASSERT_EQUAL(duplicates[0].original_id, 1);
+	ASSERT(abs(duplicates[0].similarity - 20.0 / 21.0) < 1e-9);
+	ASSERT_EQUAL(duplicates[1].document_id, 4);
+	ASSERT_EQUAL(duplicates[1].original_id, 1);
+	ASSERT_EQUAL(duplicates[1].similarity, 1.0);
+
+	// 3 and 5 share 3 of 7 words
+	NearDuplicateOptions options;
+	options.jaccard_threshold = 0.4;
+	options.band_count = 64;
+	options.rows_per_band = 2;
+	RemoveNearDuplicates(server, options);
+	ASSERT_EQUAL(vector<int>(server.begin(), server.end()), (vector<int>{ 1, 3 }));
+
+	options.jaccard_threshold = 1.5;
+	bool rejected = false;
+	try {
+		FindNearDuplicates(server, options);
+	}
+	catch (const invalid_argument&) {
+		rejected = true;
+	}
+	ASSERT(rejected);
+}
+
+void TestParallelFindTopDocuments() {
+	mt19937 generator(5);
+	const vector<string> words = { "cat"s, "dog"s, "rat"s, "funny"s, "nasty"s, "curly"s, "big"s, "tail"s, "collar"s, "and"s };
+	const vector<DocumentStatus> statuses = { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED,
+		DocumentStatus::REMOVED };
+	SearchServer search_server("and"s);
+	// Enough documents for the parallel version to split them over several partitions
+	for (int id = 0; id < 3000; ++id) {
+		string text;
+		for (int j = 0; j < 8; ++j) {
+			text += words[generator() % words.size()] + ' ';
+		}
+		search_server.AddDocument(id, text, statuses[generator() % statuses.size()], { static_cast<int>(generator() % 11) - 5 });
+	}
+	search_server.SetParallelism(4);
+
+	// The partitions sum the same term scores, possibly in another order
+	const auto check = [](const vector<Document>& documents, const vector<Document>& expected, const string& hint) {
+		ASSERT_EQUAL_HINT(documents.size(), expected.size(), hint);
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQUAL_HINT(documents[i].id, expected[i].id, hint);
+			ASSERT_HINT(abs(documents[i].relevance - expected[i].relevance) < SearchServer::eps, hint);
+			ASSERT_EQUAL_HINT(documents[i].rating, expected[i].rating, hint);
+		}
+	};
+	const auto predicate = [](int document_id, DocumentStatus status, int rating) {
+		return document_id % 3 == 0 && status != DocumentStatus::BANNED && rating > 0;
+	};
+	for (const string& query : { "cat"s, "funny nasty -tail"s, "curly dog rat -big"s, "collar collar"s, "parrot"s, "-cat"s }) {
+		check(search_server.FindTopDocuments(execution::par, query), search_server.FindTopDocuments(execution::seq, query), query);
+		for (const DocumentStatus status : statuses) {
+			check(search_server.FindTopDocuments(execution::par, query, status),
+				search_server.FindTopDocuments(execution::seq, query, status), query);
+		}
+		check(search_server.FindTopDocuments(execution::par, query, predicate),
+			search_server.FindTopDocuments(execution::seq, query, predicate), query);
+	}
+}
+
+void TestPostingListsMatchWordMap() {
+	mt19937 generator(11);
+	const vector<string> words = { "cat"s, "dog"s, "rat"s, "funny"s, "nasty"s, "curly"s, "big"s, "tail"s, "collar"s, "parrot"s };
+	SearchServer search_server(""s);
+	// The layout the postings replaced: word -> document -> term frequency
+	map<string, map<int, double>> word_to_document_freqs;
+	vector<int> ids(300);
+	for (size_t i = 0; i < ids.size(); ++i) {
+		ids[i] = static_cast<int>(i);
+	}
+	// Ids out of order go into the middle of the posting lists
+	shuffle(ids.begin(), ids.end(), generator);
+	for (const int id : ids) {
+		const size_t word_count = 1 + generator() % 6;
+		string text;
+		for (size_t j = 0; j < word_count; ++j) {
+			const string& word = words[generator() % words.size()];
+			text += word + ' ';
+			word_to_document_freqs[word][id] += 1.0 / word_count;
+		}
+		search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+	}
+	for (int id = 0; id < static_cast<int>(ids.size()); id += 5) {
+		search_server.RemoveDocument(id);
+		for (auto& [word, document_freqs] : word_to_document_freqs) {
+			document_freqs.erase(id);
+		}
+	}
+
+	for (const string& word : words) {
+		ASSERT_EQUAL_HINT(search_server.GetDocumentFreq(word), static_cast<int>(word_to_document_freqs[word].size()), word);
+	}
+	for (const vector<string>& query : { vector<string>{ "cat"s }, vector<string>{ "dog"s, "tail"s }, vector<string>{ "funny"s, "nasty"s, "parrot"s } }) {
+		map<int, double> relevances;
+		string raw_query;
+		for (const string& word : query) {
+			const double idf = log(search_server.GetDocumentCount() * 1.0 / word_to_document_freqs[word].size());
+			for (const auto [id, term_freq] : word_to_document_freqs[word]) {
+				relevances[id] += term_freq * idf;
+			}
+			raw_query += word + ' ';
+		}
+		vector<Document> expected;
+		for (const auto [id, relevance] : relevances) {
+			expected.push_back({ id, relevance, id });
+		}
+		sort(expected.begin(), expected.end(), TopDocuments::IsBetter);
+		expected.resize(min(expected.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)));
+
+		const auto documents = search_server.FindTopDocuments(raw_query);
+		ASSERT_EQUAL_HINT(documents.size(), expected.size(), raw_query);
+		for (size_t i = 0; i < expected.size(); ++i) {
+			ASSERT_EQUAL_HINT(documents[i].id, expected[i].id, raw_query);
+			ASSERT_HINT(abs(documents[i].relevance - expected[i].relevance) < 1e-9, raw_query);
+		}
+	}
+}
+
+void TestRelevanceAccumulator() {
+	RelevanceAccumulator accumulator;
+	accumulator.Reset(100);
+	accumulator.Exclude(70);
+	accumulator.Add(3, 0.5);
+	accumulator.Add(64, 1.0);
+	accumulator.Add(3, 0.25);
+	ASSERT(accumulator.GetTouched() == vector<int>({ 3, 64 }));
+	ASSERT(abs(accumulator.GetRelevance(3) - 0.75) < 1e-12);
+	ASSERT(accumulator.IsTouched(64));
+	ASSERT(!accumulator.IsTouched(4));
+	ASSERT(accumulator.IsExcluded(70));
+	ASSERT(!accumulator.IsExcluded(71));
+
+	// Nothing of the previous query is left, also when the corpus has grown
+	accumulator.Reset(200);
+	ASSERT(accumulator.GetTouched().empty());
+	ASSERT(!accumulator.IsTouched(3));
+	ASSERT(!accumulator.IsExcluded(70));
+	accumulator.Add(150, 2.0);
+	accumulator.Add(3, 0.5);
+	ASSERT(accumulator.GetTouched() == vector<int>({ 150, 3 }));
+	ASSERT(abs(accumulator.GetRelevance(3) - 0.5) < 1e-12);
+	ASSERT(abs(accumulator.GetRelevance(150) - 2.0) < 1e-12);
+}
+
+void TestTermDictionary() {
+	TermDictionary terms;
+	ASSERT_EQUAL(terms.Find("cat"sv), TermDictionary::NO_TERM);
+	ASSERT_EQUAL(terms.Intern("cat"sv), 0u);
+	ASSERT_EQUAL(terms.Intern("dog"sv), 1u);
+	ASSERT_EQUAL(terms.Intern("cat"sv), 0u);
+	const string_view cat = terms.GetTerm(0);
+
+	// Ids stay dense and the views stay valid while the table and the arena grow
+	for (uint32_t i = 0; i < 100'000; ++i) {
+		ASSERT_EQUAL(terms.Intern("term"s + to_string(i)), i + 2);
+	}
+	const string long_term(100'000, 'x');
+	const uint32_t long_term_id = terms.Intern(long_term);
+	ASSERT_EQUAL(terms.size(), 100'003u);
+	ASSERT(cat == "cat"sv && cat.data() == terms.GetTerm(0).data());
+	ASSERT(terms.GetTerm(long_term_id) == long_term);
+	ASSERT_EQUAL(terms.Find("term4242"s), 4244u);
+	ASSERT_EQUAL(terms.Find("term100000"s), TermDictionary::NO_TERM);
+
+	// A copy interns on its own
+	TermDictionary copy = terms;
+	ASSERT_EQUAL(copy.Intern("parrot"sv), 100'003u);
+	ASSERT_EQUAL(terms.Find("parrot"sv), TermDictionary::NO_TERM);
+	ASSERT_EQUAL(terms.Intern("hamster"sv), 100'003u);
+	ASSERT(copy.GetTerm(100'003) == "parrot"sv);
+	ASSERT_EQUAL(copy.Find("term7"s), 9u);
+}
+
 //  TestSearchServer      
 void TestSearchServer() {
 	RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
@@ -166,6 +1381,31 @@ void TestSearchServer() {
 	RUN_TEST(TestRelevanceSortCheck);
 	RUN_TEST(TestRatingCalc);
 	RUN_TEST(TestPredicatAndRelevanceCalc);
+	RUN_TEST(TestRemoveDocument);
+	RUN_TEST(TestTopDocumentsCount);
+	RUN_TEST(TestInverseDocumentFreqCache);
+	RUN_TEST(TestDynamicPruning);
+	RUN_TEST(TestPostingListBlocks);
+	RUN_TEST(TestIndexSnapshot);
+	RUN_TEST(TestAddDocuments);
+	RUN_TEST(TestLoadCorpus);
+	RUN_TEST(TestSplitIntoWords);
+	RUN_TEST(TestStopWordFilter);
+	RUN_TEST(TestQueryCache);
+	RUN_TEST(TestQueryExecutor);
+	RUN_TEST(TestProcessQueriesJoined);
+	RUN_TEST(TestCancellableQueries);
+	RUN_TEST(TestConcurrentSearchServer);
+	RUN_TEST(TestSegmentedSearchServer);
+	RUN_TEST(TestShardedSearchServer);
+	RUN_TEST(TestRemoteShards);
+	RUN_TEST(TestRemoveDocumentTombstones);
+	RUN_TEST(TestRemoveDuplicates);
+	RUN_TEST(TestNearDuplicates);
+	RUN_TEST(TestParallelFindTopDocuments);
+	RUN_TEST(TestPostingListsMatchWordMap);
+	RUN_TEST(TestRelevanceAccumulator);
+	RUN_TEST(TestTermDictionary);
 	//      
 }
 
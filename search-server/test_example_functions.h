@@ -62,6 +62,56 @@ void TestRatingCalc();
 
 void TestPredicatAndRelevanceCalc();
 
+void TestRemoveDocument();
+
+void TestTopDocumentsCount();
+
+void TestInverseDocumentFreqCache();
+
+void TestDynamicPruning();
+
+void TestPostingListBlocks();
+
+void TestIndexSnapshot();
+
+void TestAddDocuments();
+
+void TestLoadCorpus();
+
+void TestSplitIntoWords();
+
+void TestStopWordFilter();
+
+void TestQueryCache();
+
+void TestQueryExecutor();
+
+void TestProcessQueriesJoined();
+
+void TestCancellableQueries();
+
+void TestConcurrentSearchServer();
+
+void TestSegmentedSearchServer();
+
+void TestShardedSearchServer();
+
+void TestRemoteShards();
+
+void TestRemoveDocumentTombstones();
+
+void TestRemoveDuplicates();
+
+void TestNearDuplicates();
+
+void TestParallelFindTopDocuments();
+
+void TestPostingListsMatchWordMap();
+
+void TestRelevanceAccumulator();
+
+void TestTermDictionary();
+
 //  TestSearchServer      
 void TestSearchServer();
 
@@ -0,0 +1,56 @@
+#include "top_documents.h"
+#include "search_server.h"
+#include <algorithm>
+#include <cmath>
+
+TopDocuments::TopDocuments(size_t max_count)
+	: max_count_(max_count) {
+	storage_.reserve(std::min(max_count, INITIAL_CAPACITY));
+}
+
+TopDocuments::TopDocuments(Document* output, size_t max_count)
+	: max_count_(max_count)
+	, output_(output) {
+}
+
+void TopDocuments::Add(const Document& document) {
+	if (size_ < max_count_) {
+		if (output_ != nullptr) {
+			output_[size_] = document;
+		}
+		else {
+			storage_.push_back(document);
+		}
+		++size_;
+		std::push_heap(GetHeap(), GetHeap() + size_, IsBetter);
+	}
+	else if (max_count_ > 0 && IsBetter(document, GetWorst())) {
+		Document* heap = GetHeap();
+		std::pop_heap(heap, heap + size_, IsBetter);
+		heap[size_ - 1] = document;
+		std::push_heap(heap, heap + size_, IsBetter);
+	}
+}
+
+bool TopDocuments::IsBetter(const Document& lhs, const Document& rhs) {
+	if (std::abs(lhs.relevance - rhs.relevance) < SearchServer::eps) {
+		if (lhs.rating != rhs.rating) {
+			return lhs.rating > rhs.rating;
+		}
+		return lhs.id < rhs.id;
+	}
+	return lhs.relevance > rhs.relevance;
+}
+
+std::vector<Document> TopDocuments::Build() {
+	std::sort_heap(GetHeap(), GetHeap() + size_, IsBetter);
+	if (output_ != nullptr) {
+		return std::vector<Document>(output_, output_ + size_);
+	}
+	return std::move(storage_);
+}
+
+size_t TopDocuments::BuildInPlace() {
+	std::sort_heap(GetHeap(), GetHeap() + size_, IsBetter);
+	return size_;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+#include "document.h"
+
+// Keeps the best max_count documents seen so far in a bounded heap,
+// so selecting the top never sorts the whole candidate set
+class TopDocuments {
+public:
+    // Storage grows with the documents added, so a huge max_count costs nothing up front
+    explicit TopDocuments(size_t max_count);
+
+    // Keeps the heap in output, which must have room for max_count documents, instead of allocating
+    TopDocuments(Document* output, size_t max_count);
+
+    // A copy would share output
+    TopDocuments(const TopDocuments&) = delete;
+    TopDocuments& operator=(const TopDocuments&) = delete;
+
+    void Add(const Document& document);
+
+    // Relevance order of FindTopDocuments: relevance, then rating for relevances within eps, then id
+    static bool IsBetter(const Document& lhs, const Document& rhs);
+
+    size_t GetMaxCount() const {
+        return max_count_;
+    }
+
+    bool IsFull() const {
+        return size_ >= max_count_;
+    }
+
+    // The document a newcomer has to beat; only valid when not empty
+    const Document& GetWorst() const {
+        return output_ != nullptr ? output_[0] : storage_[0];
+    }
+
+    std::vector<Document> Build();
+
+    // Sorts the documents where they are kept and returns their number; for the output constructor
+    size_t BuildInPlace();
+
+private:
+    // Capacity reserved up front at most
+    inline static constexpr size_t INITIAL_CAPACITY = 64;
+
+    size_t max_count_;
+    // The heap, ordered by IsBetter so the worst kept document sits at the front, lives in output_
+    // when there is one and in storage_ otherwise
+    std::vector<Document> storage_;
+    Document* output_ = nullptr;
+    size_t size_ = 0;
+
+    Document* GetHeap() {
+        return output_ != nullptr ? output_ : storage_.data();
+    }
+};